@@ -0,0 +1,51 @@
+//===-- BranchHistDump.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// klee-dump-brhist: prints the branch histories of a _br_hist file one per
+// line, as the '0'..'3' paths prefix tasks are made of.
+//
+//   klee-dump-brhist <output dir>_br_hist [first] [count]
+//
+//===----------------------------------------------------------------------===//
+
+#include "BranchHistory.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace klee;
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <br_hist> [first] [count]\n", argv[0]);
+    return 1;
+  }
+  BranchHistReader reader(argv[1]);
+  if (!reader.good()) {
+    fprintf(stderr, "%s: cannot open\n", argv[1]);
+    return 1;
+  }
+  unsigned long first = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+  unsigned long count = argc > 3 ? strtoul(argv[3], NULL, 10) : 0;
+
+  //the records are delta encoded, the skipped ones are still read
+  std::vector<unsigned char> path;
+  unsigned long printed = 0;
+  for (unsigned long i = 0; (!count || printed < count) && reader.next(path);
+       ++i) {
+    if (i < first)
+      continue;
+    if (!path.empty())
+      fwrite(&path[0], 1, path.size(), stdout);
+    fputc('\n', stdout);
+    ++printed;
+  }
+  return 0;
+}
@@ -0,0 +1,194 @@
+//===-- BranchHistory.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BranchHistory.h"
+
+#include <cstring>
+
+using namespace klee;
+
+//bytes of records buffered before they are written
+#define BRANCH_HIST_BLOCK (1 << 20)
+
+namespace {
+  void put32(std::vector<char> &out, uint32_t v) {
+    const char *p = (const char *) &v;
+    out.insert(out.end(), p, p + sizeof(v));
+  }
+
+  void putNumber(std::vector<char> &out, uint32_t v) {
+    while (v >= 0x80) {
+      out.push_back((char) (v | 0x80));
+      v >>= 7;
+    }
+    out.push_back((char) v);
+  }
+
+  bool get32(const char *&cur, const char *end, uint32_t &v) {
+    if ((size_t) (end - cur) < sizeof(v))
+      return false;
+    memcpy(&v, cur, sizeof(v));
+    cur += sizeof(v);
+    return true;
+  }
+}
+
+std::string PackedBranchHist::key() const {
+  std::string k((const char *) &length, sizeof(length));
+  if (!words.empty())
+    k.append((const char *) &words[0], words.size() * sizeof(uint64_t));
+  return k;
+}
+
+uint32_t PackedBranchHist::commonPrefix(const PackedBranchHist &other) const {
+  uint32_t n = length < other.length ? length : other.length;
+  for (uint32_t i = 0, e = (n + 31) / 32; i < e; ++i) {
+    uint64_t diff = words[i] ^ other.words[i];
+    if (diff) {
+      uint32_t pos = i * 32 + __builtin_ctzll(diff) / 2;
+      return pos < n ? pos : n;
+    }
+  }
+  return n;
+}
+
+void PackedBranchHist::appendBytes(std::vector<char> &out) const {
+  // only the bytes actually holding decisions go on the wire
+  if (words.empty())
+    return;
+  unsigned bytes = (length * 2 + 7) / 8;
+  const char *p = (const char *) &words[0];
+  out.insert(out.end(), p, p + bytes);
+}
+
+bool PackedBranchHist::readBytes(const char *&cur, const char *end, uint32_t len) {
+  //64 bit, a corrupt length must not wrap around to a small one
+  uint64_t bytes = ((uint64_t) len * 2 + 7) / 8;
+  if ((uint64_t) (end - cur) < bytes)
+    return false;
+  words.assign(((uint64_t) len + 31) / 32, 0);
+  if (bytes)
+    memcpy(&words[0], cur, bytes);
+  // drop the padding bits so key() of equal histories agrees
+  if (len & 31)
+    words.back() &= ((uint64_t) 1 << ((len & 31) * 2)) - 1;
+  length = len;
+  cur += bytes;
+  return true;
+}
+
+void PrefixPacket::encode(std::vector<char> &out) const {
+  put32(out, common.size());
+  put32(out, suffixes.size());
+  common.appendBytes(out);
+  for (std::vector<PackedBranchHist>::const_iterator it = suffixes.begin(),
+         ie = suffixes.end(); it != ie; ++it) {
+    put32(out, it->size());
+    it->appendBytes(out);
+  }
+}
+
+bool PrefixPacket::decode(const char *buf, unsigned size) {
+  const char *cur = buf, *end = buf + size;
+  uint32_t commonLen, numSuffixes;
+  if (!get32(cur, end, commonLen) || !get32(cur, end, numSuffixes))
+    return false;
+  if (!common.readBytes(cur, end, commonLen))
+    return false;
+  suffixes.assign(numSuffixes, PackedBranchHist());
+  for (uint32_t i = 0; i < numSuffixes; ++i) {
+    uint32_t len;
+    if (!get32(cur, end, len) || !suffixes[i].readBytes(cur, end, len))
+      return false;
+  }
+  return cur == end;
+}
+
+void PrefixPacket::getPath(int index, std::vector<unsigned char> &out) const {
+  out.clear();
+  out.reserve(common.size() + (index < 0 ? 0 : suffixes[index].size()));
+  for (uint32_t i = 0; i < common.size(); ++i)
+    out.push_back(common[i]);
+  if (index < 0)
+    return;
+  const PackedBranchHist &suffix = suffixes[index];
+  for (uint32_t i = 0; i < suffix.size(); ++i)
+    out.push_back(suffix[i]);
+}
+
+BranchHistWriter::BranchHistWriter(const std::string &path)
+  : file(fopen(path.c_str(), "wb")) {
+  buffer.reserve(BRANCH_HIST_BLOCK);
+}
+
+BranchHistWriter::~BranchHistWriter() {
+  flush();
+  if (file)
+    fclose(file);
+}
+
+void BranchHistWriter::append(const PackedBranchHist &path) {
+  uint32_t common = path.commonPrefix(last);
+  uint32_t rest = path.size() - common;
+  putNumber(buffer, common);
+  putNumber(buffer, rest);
+  for (uint32_t i = 0; i < rest; i += 4) {
+    unsigned char packed = 0;
+    for (uint32_t j = 0; j < 4 && i + j < rest; ++j)
+      packed |= ((path[common + i + j] - '0') & 3) << (j * 2);
+    buffer.push_back((char) packed);
+  }
+  last = path;
+  if (buffer.size() >= BRANCH_HIST_BLOCK)
+    flush();
+}
+
+void BranchHistWriter::flush() {
+  if (file && !buffer.empty())
+    fwrite(&buffer[0], 1, buffer.size(), file);
+  buffer.clear();
+}
+
+BranchHistReader::BranchHistReader(const std::string &path)
+  : file(fopen(path.c_str(), "rb")) {}
+
+BranchHistReader::~BranchHistReader() {
+  if (file)
+    fclose(file);
+}
+
+bool BranchHistReader::readNumber(uint32_t &v) {
+  v = 0;
+  for (unsigned shift = 0; shift < 35; shift += 7) {
+    int c = fgetc(file);
+    if (c == EOF)
+      return false;
+    v |= (uint32_t) (c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool BranchHistReader::next(std::vector<unsigned char> &path) {
+  uint32_t common, rest;
+  if (!file || !readNumber(common) || !readNumber(rest) ||
+      common > current.size())
+    return false;
+  current.resize(common);
+  for (uint32_t i = 0; i < rest; i += 4) {
+    int c = fgetc(file);
+    if (c == EOF)
+      return false;
+    for (uint32_t j = 0; j < 4 && i + j < rest; ++j)
+      current.push_back('0' + ((c >> (j * 2)) & 3));
+  }
+  path = current;
+  return true;
+}
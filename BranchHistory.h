@@ -0,0 +1,127 @@
+//===-- BranchHistory.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Two bits per branch decision ('0'..'3' in ExecutionState::branchHist), the
+// length-prefixed wire format used for prefix tasks and offload replies, and
+// the delta-encoded file of the histories of terminated states.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BRANCHHISTORY_H
+#define KLEE_BRANCHHISTORY_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace klee {
+
+class PackedBranchHist {
+  std::vector<uint64_t> words;
+  uint32_t length;
+
+public:
+  PackedBranchHist() : length(0) {}
+
+  template <typename Iter>
+  PackedBranchHist(Iter begin, Iter end) : length(0) {
+    for (; begin != end; ++begin)
+      push_back(*begin);
+  }
+
+  /// Appends an ASCII decision, '0'..'3'.
+  void push_back(unsigned char decision) {
+    if ((length & 31) == 0)
+      words.push_back(0);
+    words.back() |= (uint64_t) ((decision - '0') & 3) << ((length & 31) * 2);
+    ++length;
+  }
+
+  /// Returns the ASCII decision at \param index.
+  unsigned char operator[](uint32_t index) const {
+    return '0' + ((words[index >> 5] >> ((index & 31) * 2)) & 3);
+  }
+
+  uint32_t size() const { return length; }
+
+  /// Length of the common prefix with \param other, one word (32
+  /// decisions) at a time.
+  uint32_t commonPrefix(const PackedBranchHist &other) const;
+
+  void clear() {
+    words.clear();
+    length = 0;
+  }
+
+  /// Compact map key, the length followed by the packed words.
+  std::string key() const;
+
+  void appendBytes(std::vector<char> &out) const;
+  bool readBytes(const char *&cur, const char *end, uint32_t len);
+};
+
+/// A prefix task: a common prefix plus the suffixes of the offloaded states,
+/// no suffixes means a plain prefix to replay from main.
+///
+/// Wire layout: u32 common length, u32 suffix count, packed common, then a
+/// u32 length and packed bits per suffix.
+struct PrefixPacket {
+  PackedBranchHist common;
+  std::vector<PackedBranchHist> suffixes;
+
+  void encode(std::vector<char> &out) const;
+  bool decode(const char *buf, unsigned size);
+
+  /// ASCII form of common + suffix \param index, as consumed by the
+  /// bound/prefix setters.
+  void getPath(int index, std::vector<unsigned char> &out) const;
+};
+
+/// Histories of terminated states written one after the other. Each record
+/// is the length of the prefix shared with the previous history and the
+/// number of decisions after it (both LEB128), then those decisions packed
+/// four per byte. The records are buffered and written in large blocks.
+class BranchHistWriter {
+  FILE *file;
+  std::vector<char> buffer;
+  PackedBranchHist last;
+
+public:
+  BranchHistWriter(const std::string &path);
+  /// Writes what is still buffered.
+  ~BranchHistWriter();
+
+  bool good() const { return file; }
+
+  void append(const PackedBranchHist &path);
+  void flush();
+};
+
+/// Reads back what BranchHistWriter wrote, as ASCII paths in the form the
+/// prefix replay (pendingPrefixes, setUpperBound) takes.
+class BranchHistReader {
+  FILE *file;
+  std::vector<unsigned char> current;
+
+  bool readNumber(uint32_t &v);
+
+public:
+  BranchHistReader(const std::string &path);
+  ~BranchHistReader();
+
+  bool good() const { return file; }
+
+  /// Sets \param path to the next history, false at the end of the file.
+  bool next(std::vector<unsigned char> &path);
+};
+
+}
+
+#endif
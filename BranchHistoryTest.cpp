@@ -0,0 +1,199 @@
+//===-- BranchHistoryTest.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Round trips of the packed histories, the PrefixPacket wire format and the
+// _br_hist file, and decoding of truncated or corrupt packets. Standalone,
+// exits non-zero on the first failure:
+//
+//   c++ -std=c++14 BranchHistoryTest.cpp BranchHistory.cpp && ./a.out
+//
+//===----------------------------------------------------------------------===//
+
+#undef NDEBUG
+#include "BranchHistory.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+  //a random '0'..'3' path, deterministic per seed
+  std::vector<unsigned char> makePath(unsigned seed, unsigned length) {
+    srand(seed);
+    std::vector<unsigned char> path;
+    for (unsigned i = 0; i < length; ++i)
+      path.push_back('0' + rand() % 4);
+    return path;
+  }
+
+  std::vector<unsigned char> unpack(const PackedBranchHist &hist) {
+    std::vector<unsigned char> path;
+    for (uint32_t i = 0; i < hist.size(); ++i)
+      path.push_back(hist[i]);
+    return path;
+  }
+
+  void put32(std::vector<char> &out, uint32_t v) {
+    const char *p = (const char *) &v;
+    out.insert(out.end(), p, p + sizeof(v));
+  }
+
+  void testPacked() {
+    //around the 32 decisions of a word
+    unsigned lengths[] = { 0, 1, 31, 32, 33, 64, 100 };
+    for (unsigned i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+      std::vector<unsigned char> path = makePath(i, lengths[i]);
+      PackedBranchHist hist(path.begin(), path.end());
+      assert(hist.size() == path.size());
+      assert(unpack(hist) == path);
+
+      std::vector<char> bytes;
+      hist.appendBytes(bytes);
+      PackedBranchHist back;
+      const char *cur = bytes.empty() ? 0 : &bytes[0];
+      const char *end = cur + bytes.size();
+      assert(back.readBytes(cur, end, hist.size()));
+      assert(cur == end);
+      assert(back.key() == hist.key());
+      assert(back.commonPrefix(hist) == hist.size());
+    }
+
+    std::vector<unsigned char> a = makePath(7, 80), b = a;
+    b[45] = b[45] == '0' ? '1' : '0';
+    PackedBranchHist ha(a.begin(), a.end()), hb(b.begin(), b.end());
+    assert(ha.commonPrefix(hb) == 45);
+    assert(hb.commonPrefix(ha) == 45);
+    PackedBranchHist shorter(a.begin(), a.begin() + 40);
+    assert(ha.commonPrefix(shorter) == 40);
+    assert(ha.key() != shorter.key());
+  }
+
+  void testPacketRoundTrip() {
+    std::vector<unsigned char> common = makePath(1, 70);
+    PrefixPacket packet;
+    packet.common = PackedBranchHist(common.begin(), common.end());
+    std::vector<std::vector<unsigned char> > suffixes;
+    for (unsigned i = 0; i < 4; ++i) {
+      suffixes.push_back(makePath(10 + i, i * 17));
+      packet.suffixes.push_back(
+          PackedBranchHist(suffixes[i].begin(), suffixes[i].end()));
+    }
+    std::vector<char> wire;
+    packet.encode(wire);
+
+    PrefixPacket back;
+    assert(back.decode(&wire[0], wire.size()));
+    assert(back.suffixes.size() == suffixes.size());
+    std::vector<unsigned char> path;
+    back.getPath(-1, path);
+    assert(path == common);
+    for (unsigned i = 0; i < suffixes.size(); ++i) {
+      std::vector<unsigned char> expected = common;
+      expected.insert(expected.end(), suffixes[i].begin(), suffixes[i].end());
+      back.getPath(i, path);
+      assert(path == expected);
+    }
+
+    //a plain prefix, no suffixes
+    PrefixPacket plain, plainBack;
+    plain.common = packet.common;
+    std::vector<char> plainWire;
+    plain.encode(plainWire);
+    assert(plainBack.decode(&plainWire[0], plainWire.size()));
+    assert(plainBack.suffixes.empty());
+    assert(plainBack.common.key() == plain.common.key());
+  }
+
+  void testPacketMalformed() {
+    std::vector<unsigned char> common = makePath(2, 50);
+    std::vector<unsigned char> suffix = makePath(3, 20);
+    PrefixPacket packet;
+    packet.common = PackedBranchHist(common.begin(), common.end());
+    packet.suffixes.push_back(PackedBranchHist(suffix.begin(), suffix.end()));
+    std::vector<char> wire;
+    packet.encode(wire);
+
+    //every truncation, and trailing garbage
+    PrefixPacket back;
+    for (unsigned size = 0; size < wire.size(); ++size)
+      assert(!back.decode(&wire[0], size));
+    wire.push_back(0);
+    assert(!back.decode(&wire[0], wire.size()));
+
+    //lengths that do not fit the buffer, including ones that would wrap
+    uint32_t lengths[] = { 51, 0x7fffffff, 0x80000000, 0xffffffff };
+    for (unsigned i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+      std::vector<char> bad;
+      put32(bad, lengths[i]);
+      put32(bad, 0);
+      bad.resize(bad.size() + 12, 0);
+      assert(!back.decode(&bad[0], bad.size()));
+    }
+    std::vector<char> manySuffixes;
+    put32(manySuffixes, 0);
+    put32(manySuffixes, 1000);
+    assert(!back.decode(&manySuffixes[0], manySuffixes.size()));
+  }
+
+  void testHistFile() {
+    char path[] = "/tmp/brhist-test-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    //shared prefixes, a repeat, an extension, an empty history
+    std::vector<std::vector<unsigned char> > histories;
+    histories.push_back(makePath(4, 90));
+    histories.push_back(histories[0]);
+    histories.push_back(std::vector<unsigned char>(histories[0].begin(),
+                                                   histories[0].begin() + 60));
+    histories.back().push_back(histories[0][60] == '0' ? '1' : '0');
+    histories.push_back(histories[0]);
+    histories.back().insert(histories.back().end(), 5, '2');
+    histories.push_back(std::vector<unsigned char>());
+    histories.push_back(makePath(5, 33));
+
+    {
+      BranchHistWriter writer(path);
+      assert(writer.good());
+      for (unsigned i = 0; i < histories.size(); ++i) {
+        writer.append(PackedBranchHist(histories[i].begin(),
+                                       histories[i].end()));
+        //an early flush must not break the delta encoding
+        if (i == 2)
+          writer.flush();
+      }
+    }
+
+    BranchHistReader reader(path);
+    assert(reader.good());
+    std::vector<unsigned char> read;
+    for (unsigned i = 0; i < histories.size(); ++i) {
+      assert(reader.next(read));
+      assert(read == histories[i]);
+    }
+    assert(!reader.next(read));
+    unlink(path);
+  }
+}
+
+int main() {
+  testPacked();
+  testPacketRoundTrip();
+  testPacketMalformed();
+  testHistFile();
+  printf("BranchHistoryTest: ok\n");
+  return 0;
+}
@@ -0,0 +1,134 @@
+//===-- Checkpoint.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Checkpoint.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+using namespace klee;
+
+#define CHECKPOINT_MAGIC "KCKP"
+#define CHECKPOINT_VERSION 1
+
+void CheckpointImage::add(const char *packet, uint32_t len) {
+  const char *p = (const char *) &len;
+  tasks.insert(tasks.end(), p, p + sizeof(len));
+  tasks.insert(tasks.end(), packet, packet + len);
+  ++numTasks;
+}
+
+CheckpointWriter::CheckpointWriter(const std::string &_path)
+  : path(_path), hasQueued(false), closing(false), writing(false) {
+  writer = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    closing = true;
+  }
+  wake.notify_one();
+  writer.join();
+}
+
+void CheckpointWriter::submit(CheckpointImage &image) {
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    std::swap(queued, image);
+    hasQueued = true;
+  }
+  wake.notify_one();
+}
+
+bool CheckpointWriter::write(CheckpointImage &image) {
+  //a queued older image must not land after this one, nor one in flight
+  std::unique_lock<std::mutex> guard(lock);
+  hasQueued = false;
+  while (writing)
+    idle.wait(guard);
+  return writeFile(image);
+}
+
+void CheckpointWriter::run() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    while (!hasQueued && !closing)
+      wake.wait(guard);
+    if (!hasQueued)
+      return;
+    CheckpointImage image;
+    std::swap(image, queued);
+    hasQueued = false;
+    //submit() runs on the master's event loop, it must not wait for a
+    //file and its fsync
+    writing = true;
+    guard.unlock();
+    bool ok = writeFile(image);
+    guard.lock();
+    writing = false;
+    idle.notify_all();
+    if (!ok)
+      klee_warning("cannot write checkpoint '%s'", path.c_str());
+  }
+}
+
+bool CheckpointWriter::writeFile(const CheckpointImage &image) {
+  std::string tmp = path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f)
+    return false;
+  uint32_t head[2] = { CHECKPOINT_VERSION, image.numTasks };
+  bool ok = fwrite(CHECKPOINT_MAGIC, 4, 1, f) == 1 &&
+            fwrite(head, sizeof(head), 1, f) == 1 &&
+            (image.tasks.empty() ||
+             fwrite(&image.tasks[0], image.tasks.size(), 1, f) == 1) &&
+            fflush(f) == 0 && fsync(fileno(f)) == 0;
+  ok = fclose(f) == 0 && ok;
+  return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+unsigned klee::unpackTasks(const std::vector<char> &batch,
+                           std::deque<std::vector<char> > &out) {
+  unsigned numTasks = 0;
+  for (uint32_t pos = 0; pos + sizeof(uint32_t) <= batch.size(); ++numTasks) {
+    uint32_t len;
+    memcpy(&len, &batch[pos], sizeof(len));
+    pos += sizeof(len);
+    assert(pos + len <= batch.size() && "malformed task batch");
+    out.push_back(std::vector<char>(batch.begin() + pos, batch.begin() + pos + len));
+    pos += len;
+  }
+  return numTasks;
+}
+
+bool klee::readCheckpoint(const std::string &path,
+                          std::deque<std::vector<char> > &tasks) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  char magic[4];
+  uint32_t head[2];
+  bool ok = fread(magic, 4, 1, f) == 1 && !memcmp(magic, CHECKPOINT_MAGIC, 4) &&
+            fread(head, sizeof(head), 1, f) == 1 && head[0] == CHECKPOINT_VERSION;
+  for (uint32_t i = 0; ok && i < head[1]; ++i) {
+    uint32_t len;
+    ok = fread(&len, sizeof(len), 1, f) == 1;
+    if (!ok)
+      break;
+    tasks.push_back(std::vector<char>(len));
+    ok = !len || fread(&tasks.back()[0], len, 1, f) == 1;
+  }
+  fclose(f);
+  return ok;
+}
@@ -0,0 +1,83 @@
+//===-- Checkpoint.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Frontier of a partitioned run for -checkpoint and -restart-from: every
+// prefix task not yet known to be explored, the master's unsent worklist
+// and the states the workers reported. A file is
+//
+//   "KCKP", uint32 version, uint32 task count,
+//   then per task uint32 length and a plain PrefixPacket
+//
+// and is replaced atomically, a half written checkpoint is never read.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CHECKPOINT_H
+#define KLEE_CHECKPOINT_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace klee {
+
+/// Tasks framed as in a NEW_TASK batch, u32 length then the packet.
+struct CheckpointImage {
+  std::vector<char> tasks;
+  uint32_t numTasks;
+
+  CheckpointImage() : numTasks(0) {}
+
+  void add(const char *packet, uint32_t len);
+  void add(const std::vector<char> &packet) {
+    add(packet.empty() ? 0 : &packet[0], packet.size());
+  }
+};
+
+/// Writes checkpoints from a background thread, a queued image not yet
+/// written is replaced by a newer one.
+class CheckpointWriter {
+  std::string path;
+  CheckpointImage queued;
+  bool hasQueued, closing;
+  /// a file is being written, without the lock held
+  bool writing;
+  std::mutex lock;
+  std::condition_variable wake, idle;
+  std::thread writer;
+
+  void run();
+  bool writeFile(const CheckpointImage &image);
+
+public:
+  CheckpointWriter(const std::string &_path);
+  /// Writes what is still queued.
+  ~CheckpointWriter();
+
+  void submit(CheckpointImage &image);
+  /// Writes \param image before returning, for the last checkpoint.
+  bool write(CheckpointImage &image);
+};
+
+/// Appends the tasks of the checkpoint at \param path to \param tasks.
+bool readCheckpoint(const std::string &path,
+                    std::deque<std::vector<char> > &tasks);
+
+/// Appends the packets of a NEW_TASK style batch to \param out, returns
+/// their number.
+unsigned unpackTasks(const std::vector<char> &batch,
+                     std::deque<std::vector<char> > &out);
+
+}
+
+#endif
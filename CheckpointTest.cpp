@@ -0,0 +1,152 @@
+//===-- CheckpointTest.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Round trips of checkpoint files and NEW_TASK batches, and reading of
+// truncated or foreign checkpoints. Standalone but for klee_warning, exits
+// non-zero on the first failure:
+//
+//   c++ -std=c++14 -pthread CheckpointTest.cpp Checkpoint.cpp BranchHistory.cpp
+//       -lkleeSupport && ./a.out
+//
+//===----------------------------------------------------------------------===//
+
+#undef NDEBUG
+#include "BranchHistory.h"
+#include "Checkpoint.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+  std::vector<char> makePacket(unsigned seed, unsigned commonLen,
+                               unsigned numSuffixes) {
+    srand(seed);
+    PrefixPacket packet;
+    for (unsigned i = 0; i < commonLen; ++i)
+      packet.common.push_back('0' + rand() % 4);
+    packet.suffixes.resize(numSuffixes);
+    for (unsigned i = 0; i < numSuffixes; ++i)
+      for (unsigned j = 0; j < i * 9; ++j)
+        packet.suffixes[i].push_back('0' + rand() % 4);
+    std::vector<char> wire;
+    packet.encode(wire);
+    return wire;
+  }
+
+  std::vector<std::vector<char> > makeTasks() {
+    std::vector<std::vector<char> > tasks;
+    tasks.push_back(makePacket(1, 0, 0));
+    tasks.push_back(makePacket(2, 40, 0));
+    tasks.push_back(makePacket(3, 77, 3));
+    //an empty entry still takes a slot
+    tasks.push_back(std::vector<char>());
+    return tasks;
+  }
+
+  std::string tempPath() {
+    char path[] = "/tmp/checkpoint-test-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    return path;
+  }
+
+  void writeBytes(const std::string &path, const std::vector<char> &bytes) {
+    FILE *f = fopen(path.c_str(), "wb");
+    assert(f);
+    if (!bytes.empty())
+      assert(fwrite(&bytes[0], 1, bytes.size(), f) == bytes.size());
+    fclose(f);
+  }
+
+  std::vector<char> readBytes(const std::string &path) {
+    std::vector<char> bytes;
+    FILE *f = fopen(path.c_str(), "rb");
+    assert(f);
+    int c;
+    while ((c = fgetc(f)) != EOF)
+      bytes.push_back(c);
+    fclose(f);
+    return bytes;
+  }
+
+  void testBatch() {
+    std::vector<std::vector<char> > tasks = makeTasks();
+    CheckpointImage image;
+    for (unsigned i = 0; i < tasks.size(); ++i)
+      image.add(tasks[i]);
+    assert(image.numTasks == tasks.size());
+
+    std::deque<std::vector<char> > out;
+    out.push_back(std::vector<char>(1, 'x'));
+    assert(unpackTasks(image.tasks, out) == tasks.size());
+    //appended after what was there
+    assert(out.size() == tasks.size() + 1);
+    for (unsigned i = 0; i < tasks.size(); ++i)
+      assert(out[i + 1] == tasks[i]);
+
+    std::deque<std::vector<char> > none;
+    assert(unpackTasks(std::vector<char>(), none) == 0 && none.empty());
+  }
+
+  void testFile() {
+    std::vector<std::vector<char> > tasks = makeTasks();
+    std::string path = tempPath();
+    {
+      CheckpointWriter writer(path);
+      CheckpointImage first;
+      first.add(tasks[0]);
+      writer.submit(first);
+      //the final write replaces whatever the thread had queued
+      CheckpointImage last;
+      for (unsigned i = 0; i < tasks.size(); ++i)
+        last.add(tasks[i]);
+      assert(writer.write(last));
+    }
+    std::deque<std::vector<char> > read;
+    assert(readCheckpoint(path, read));
+    assert(read.size() == tasks.size());
+    for (unsigned i = 0; i < tasks.size(); ++i)
+      assert(read[i] == tasks[i]);
+
+    //every truncation is rejected
+    std::vector<char> bytes = readBytes(path);
+    for (unsigned size = 0; size < bytes.size(); ++size) {
+      writeBytes(path, std::vector<char>(bytes.begin(), bytes.begin() + size));
+      std::deque<std::vector<char> > partial;
+      assert(!readCheckpoint(path, partial));
+    }
+
+    //another magic or version
+    std::vector<char> foreign = bytes;
+    foreign[0] = 'X';
+    writeBytes(path, foreign);
+    assert(!readCheckpoint(path, read));
+    foreign = bytes;
+    foreign[4] = 2;
+    writeBytes(path, foreign);
+    assert(!readCheckpoint(path, read));
+
+    unlink(path.c_str());
+    assert(!readCheckpoint(path, read));
+  }
+}
+
+int main() {
+  testBatch();
+  testFile();
+  printf("CheckpointTest: ok\n");
+  return 0;
+}
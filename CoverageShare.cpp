@@ -0,0 +1,94 @@
+//===-- CoverageShare.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CoverageShare.h"
+
+#include "klee/Statistic.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+using namespace klee;
+
+//the rank holding the window
+#define COVERAGE_OWNER 0
+
+namespace {
+  cl::opt<unsigned>
+  ShareCoverage("share-coverage",
+                cl::desc("Share the covered instructions between the ranks over "
+                         "MPI RMA, for ids up to this value (default=0 (off))"),
+                cl::init(0));
+}
+
+namespace klee {
+  CoverageShare *theCoverageShare = 0;
+
+  namespace stats {
+    Statistic coveragePublished("CoveragePublished", "CovPub");
+  }
+}
+
+CoverageShare::CoverageShare(unsigned _numIds)
+  : win(MPI_WIN_NULL), words(0), numIds(_numIds), numWords((_numIds + 63) / 64),
+    known(numWords), fetched(numWords), dirtyBegin(0), dirtyEnd(0) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Aint bytes = (rank == COVERAGE_OWNER) ? numWords * sizeof(uint64_t) : 0;
+
+  MPI_Win_allocate(bytes, sizeof(uint64_t), MPI_INFO_NULL, MPI_COMM_WORLD,
+                   &words, &win);
+  if (bytes)
+    memset(words, 0, bytes);
+  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+}
+
+CoverageShare::~CoverageShare() {
+  MPI_Win_unlock_all(win);
+  MPI_Win_free(&win);
+}
+
+void CoverageShare::initialize() {
+  if (ShareCoverage)
+    theCoverageShare = new CoverageShare(ShareCoverage);
+}
+
+void CoverageShare::finalize() {
+  delete theCoverageShare;
+  theCoverageShare = 0;
+}
+
+void CoverageShare::exchange(std::vector<unsigned> &learned) {
+  //only the changed span goes out, or-ing in the unchanged words is harmless
+  if (dirtyBegin != dirtyEnd) {
+    unsigned n = dirtyEnd - dirtyBegin;
+    MPI_Accumulate(&known[dirtyBegin], n, MPI_UINT64_T, COVERAGE_OWNER,
+                   dirtyBegin, n, MPI_UINT64_T, MPI_BOR, win);
+    stats::coveragePublished += n;
+    dirtyBegin = dirtyEnd = 0;
+  }
+  //an accumulate with MPI_NO_OP reads atomically with the other ranks' ors
+  MPI_Get_accumulate(NULL, 0, MPI_UINT64_T, &fetched[0], numWords, MPI_UINT64_T,
+                     COVERAGE_OWNER, 0, numWords, MPI_UINT64_T, MPI_NO_OP, win);
+  MPI_Win_flush(COVERAGE_OWNER, win);
+
+  for (unsigned w = 0; w < numWords; ++w) {
+    uint64_t news = fetched[w] & ~known[w];
+    known[w] |= news;
+    while (news) {
+      unsigned bit = __builtin_ctzll(news);
+      learned.push_back(w * 64 + bit);
+      news &= news - 1;
+    }
+  }
+}
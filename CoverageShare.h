@@ -0,0 +1,74 @@
+//===-- CoverageShare.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Covered instructions of all ranks, one bit per instruction id in an RMA
+// window on the master. A rank ORs in the words it changed and reads the
+// whole set back, the master's loop is never involved.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COVERAGESHARE_H
+#define KLEE_COVERAGESHARE_H
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include <mpi.h>
+
+namespace klee {
+
+class CoverageShare {
+  MPI_Win win;
+  uint64_t *words;
+  unsigned numIds, numWords;
+
+  /// what this rank covered or learned, and the last copy of the window
+  std::vector<uint64_t> known, fetched;
+  /// words of known changed since the last exchange, [dirtyBegin, dirtyEnd)
+  unsigned dirtyBegin, dirtyEnd;
+
+  CoverageShare(unsigned _numIds);
+
+public:
+  ~CoverageShare();
+
+  /// Instruction ids past this one are not shared.
+  unsigned size() const { return numIds; }
+
+  void markCovered(unsigned id) {
+    if (id >= numIds)
+      return;
+    unsigned w = id >> 6;
+    uint64_t bit = 1ULL << (id & 63);
+    if (known[w] & bit)
+      return;
+    known[w] |= bit;
+    if (dirtyBegin == dirtyEnd) {
+      dirtyBegin = w;
+      dirtyEnd = w + 1;
+    } else {
+      dirtyBegin = std::min(dirtyBegin, w);
+      dirtyEnd = std::max(dirtyEnd, w + 1);
+    }
+  }
+
+  /// Publishes what was marked since the last call and appends the ids
+  /// covered by other ranks since then to \param learned.
+  void exchange(std::vector<unsigned> &learned);
+
+  /// Collective over MPI_COMM_WORLD, every rank has to call it right
+  /// after MPI_Init. Sets theCoverageShare when -share-coverage is given.
+  static void initialize();
+  static void finalize();
+};
+
+  extern CoverageShare *theCoverageShare;
+}
+
+#endif
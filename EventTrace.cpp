@@ -0,0 +1,141 @@
+//===-- EventTrace.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "EventTrace.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <sys/resource.h>
+#include <mpi.h>
+
+using namespace llvm;
+using namespace klee;
+
+//events kept per rank, older ones are overwritten
+#define EVENT_TRACE_CAPACITY (1 << 18)
+#define EVENT_TRACE_VERSION 1
+
+namespace {
+  cl::opt<std::string>
+  EventTraceFile("event-trace",
+                 cl::desc("Prefix of the binary event traces, rank N writes <prefix>.N "
+                          "(default=off)"),
+                 cl::init(""));
+}
+
+namespace klee {
+  EventTrace *theEventTrace = 0;
+}
+
+//in the order of EventTrace::Kind
+const char *EventTrace::KindNames[] = {
+  "task-start",
+  "task-finish",
+  "ready",
+  "not-ready",
+  "offload-request",
+  "offload-response",
+  "instructions",
+  "solver-time",
+  "recovery-start",
+  "recovery-finish",
+  "idle",
+  "peak-rss",
+};
+static_assert(sizeof(EventTrace::KindNames) / sizeof(EventTrace::KindNames[0]) ==
+                  EventTrace::NumKinds,
+              "a kind without a name");
+
+EventTrace::EventTrace(const std::string &_path)
+  : ring(EVENT_TRACE_CAPACITY), next(0), start(0), rank(0), numRanks(0),
+    path(_path), dumped(false), replayInstructions(0),
+    exploreInstructions(0), solverTime(0), sinceFlush(0) {
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+  //the ranks start their clocks together
+  MPI_Barrier(MPI_COMM_WORLD);
+  start = MPI_Wtime();
+}
+
+uint64_t EventTrace::now() const {
+  return (uint64_t) ((MPI_Wtime() - start) * 1e9);
+}
+
+void EventTrace::record(Kind kind, int32_t arg, uint64_t value) {
+  Event &e = ring[next % EVENT_TRACE_CAPACITY];
+  e.time = now();
+  e.kind = kind;
+  e.arg = arg;
+  e.value = value;
+  ++next;
+}
+
+void EventTrace::flushCounters() {
+  if (replayInstructions)
+    record(Instructions, 1, replayInstructions);
+  if (exploreInstructions)
+    record(Instructions, 0, exploreInstructions);
+  if (solverTime)
+    record(SolverTime, 0, solverTime);
+  replayInstructions = exploreInstructions = solverTime = 0;
+  sinceFlush = 0;
+}
+
+void EventTrace::dump() {
+  if (dumped)
+    return;
+  dumped = true;
+  flushCounters();
+  struct rusage usage;
+  if (!getrusage(RUSAGE_SELF, &usage))
+    record(PeakRSS, 0, usage.ru_maxrss);
+
+  std::ostringstream name;
+  name << path << "." << rank;
+  FILE *f = fopen(name.str().c_str(), "wb");
+  if (!f) {
+    klee_warning("unable to write event trace %s", name.str().c_str());
+    return;
+  }
+
+  Header header;
+  memcpy(header.magic, "KTRC", 4);
+  header.version = EVENT_TRACE_VERSION;
+  header.rank = rank;
+  header.numRanks = numRanks;
+  header.count = std::min(next, (uint64_t) EVENT_TRACE_CAPACITY);
+  header.dropped = next - header.count;
+  fwrite(&header, sizeof(header), 1, f);
+
+  //oldest first, the ring may have wrapped
+  uint64_t first = next - header.count;
+  for (uint64_t i = first; i != next; ++i)
+    fwrite(&ring[i % EVENT_TRACE_CAPACITY], sizeof(Event), 1, f);
+  fclose(f);
+}
+
+void EventTrace::initialize() {
+  if (EventTraceFile.empty())
+    return;
+  theEventTrace = new EventTrace(EventTraceFile);
+}
+
+void EventTrace::finalize() {
+  if (!theEventTrace)
+    return;
+  theEventTrace->dump();
+  delete theEventTrace;
+  theEventTrace = 0;
+}
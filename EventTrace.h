@@ -0,0 +1,122 @@
+//===-- EventTrace.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Per-rank binary trace of the distributed runtime. Events go to a fixed
+// ring in memory and are written once, when the rank shuts down, to
+// <-event-trace>.<rank>. klee-trace-report merges the files of a run.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EVENTTRACE_H
+#define KLEE_EVENTTRACE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace klee {
+
+class EventTrace {
+public:
+  enum Kind {
+    TaskStart,       //value: tasks taken
+    TaskFinish,      //value: FINISH messages sent
+    Ready,
+    NotReady,
+    OffloadRequest,  //arg: asking rank
+    OffloadResponse, //arg: asking rank, value: packet bytes, 0 if refused
+    Instructions,    //arg: 1 for prefix replay, value: since the last one
+    SolverTime,      //value: nanoseconds since the last one
+    RecoveryStart,   //arg: slice id
+    RecoveryFinish,  //arg: slice id
+    Idle,            //value: nanoseconds spent waiting for a message
+    PeakRSS,         //value: kilobytes, written last
+    NumKinds
+  };
+
+  static const char *KindNames[];
+
+  struct Event {
+    /// nanoseconds since the barrier in initialize()
+    uint64_t time;
+    uint32_t kind;
+    int32_t arg;
+    uint64_t value;
+  };
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    int32_t rank, numRanks;
+    /// events written after the header and events the ring overwrote
+    uint64_t count, dropped;
+  };
+
+private:
+  std::vector<Event> ring;
+  uint64_t next;
+  double start;
+  int rank, numRanks;
+  std::string path;
+  bool dumped;
+
+  /// aggregated between two Instructions events
+  uint64_t replayInstructions, exploreInstructions, solverTime;
+  unsigned sinceFlush;
+
+  EventTrace(const std::string &_path);
+
+  void flushCounters();
+
+public:
+  uint64_t now() const;
+
+  void record(Kind kind, int32_t arg = 0, uint64_t value = 0);
+
+  void countInstruction(bool replay) {
+    if (replay)
+      ++replayInstructions;
+    else
+      ++exploreInstructions;
+    if (++sinceFlush == (1 << 16))
+      flushCounters();
+  }
+
+  void addSolverTime(uint64_t ns) { solverTime += ns; }
+
+  /// Writes the trace file, later calls do nothing. Ranks that leave
+  /// through MPI_Abort call it first.
+  void dump();
+
+  /// Collective over MPI_COMM_WORLD, every rank has to call it right
+  /// after MPI_Init. Sets theEventTrace when -event-trace is given.
+  static void initialize();
+  static void finalize();
+};
+
+  extern EventTrace *theEventTrace;
+
+/// Records how long the enclosing scope took as one event of \param kind.
+class EventTraceSpan {
+  EventTrace::Kind kind;
+  uint64_t begin;
+
+public:
+  EventTraceSpan(EventTrace::Kind _kind)
+    : kind(_kind), begin(theEventTrace ? theEventTrace->now() : 0) {}
+
+  ~EventTraceSpan() {
+    if (theEventTrace)
+      theEventTrace->record(kind, 0, theEventTrace->now() - begin);
+  }
+};
+
+}
+
+#endif
@@ -22,6 +22,12 @@
 #include "TimingSolver.h"
 #include "UserSearcher.h"
 #include "ExecutorTimerInfo.h"
+#include "BranchHistory.h"
+#include "SharedQueryCache.h"
+#include "EventTrace.h"
+#include "NodeTopology.h"
+#include "RecoveryMemo.h"
+#include "CoverageShare.h"
 
 #include "klee/ExecutionState.h"
 #include "klee/Expr.h"
@@ -105,6 +111,7 @@
 #endif
 
 #include <cassert>
+#include <cstring>
 #include <algorithm>
 #include <iomanip>
 #include <iosfwd>
@@ -116,6 +123,7 @@
 #include <sys/mman.h>
 
 #include <errno.h>
+#include <unistd.h>
 #include <cxxabi.h>
 
 #define ENABLE_LOGGING false
@@ -132,6 +140,16 @@
 #define KILL_COMP 8
 #define READY_TO_OFFLOAD 9
 #define NOT_READY_TO_OFFLOAD 10
+#define STEAL_REQ 11
+#define STEAL_RESP 12
+#define STEAL_GRANTED 13
+#define STEAL_TASK 14
+#define OFFLOAD_PKT 15
+#define MEMORY_PRESSURE 16
+#define NEW_TASK 17
+#define CHECKPOINT 18
+#define CHECKPOINT_RESP 19
+#define STEAL_ACK 22
 
 #define PREFIX_MODE 101
 #define RANGE_MODE 102
@@ -139,8 +157,29 @@
 
 #define MASTER_NODE 0
 
-#define OFFLOAD_READY_THRESH 8
-#define OFFLOAD_NOT_READY_THRESH 4
+//weight of the per-call-path fork rate in estimateSubtreeCost
+#define SUBTREE_FORK_RATE_WEIGHT 100
+
+//microseconds between steal attempts and while waiting for a victim
+#define STEAL_MIN_BACKOFF 100
+#define STEAL_MAX_BACKOFF 10000
+#define STEAL_POLL_INTERVAL 20
+
+//states the searcher proposes to the offload policy per request
+#define OFFLOAD_CANDIDATE_LIMIT 1024
+
+//instructions between two updates of the adaptive recovery split
+#define RECOVERY_SPLIT_INTERVAL 1000
+
+//bounded states sent to the master in one NEW_TASK with -split-bounded-states
+#define SPLIT_TASK_BATCH 64
+
+//seconds between two samples of the memory usage
+#define MEMORY_CHECK_RATE 0.1
+
+//instructions between two timer and message polls while -lean-replay
+//replays a prefix, a power of two
+#define LEAN_REPLAY_POLL_STRIDE 1024
 
 
 using namespace llvm;
@@ -367,11 +406,133 @@ namespace {
   llvm::cl::opt<bool> UseSlicer("use-slicer",
                       llvm::cl::desc("Slice skipped functions"),
                       llvm::cl::init(false));
+
+  cl::opt<bool>
+  AdaptiveRecoverySplit("adaptive-recovery-split",
+                        cl::desc("Split the selections between normal and recovery states from "
+                                 "the measured recovery costs and the suspended states waiting, "
+                                 "and run the recoveries of the best yielding slices first "
+                                 "(default=off)"),
+                        cl::init(false));
+
+  cl::opt<bool>
+  RecoveryMemoization("recovery-memo",
+                      cl::desc("Reuse the result of a recovery in the states forked after the "
+                               "same snapshot whose constraints imply its path (default=off)"),
+                      cl::init(false));
+
+  cl::opt<bool>
+  SplitBoundedStates("split-bounded-states",
+                     cl::desc("Send the states a worker stops at -phase2Depth to the master "
+                              "as new prefix tasks instead of dropping them (default=off)"),
+                     cl::init(false));
+
+  cl::opt<bool>
+  InternConstraints("intern-constraints",
+                    cl::desc("Hash-cons the constraints added to states, so states that "
+                             "build the same condition share its nodes (default=off)"),
+                    cl::init(false));
+
+  cl::opt<bool>
+  LeanReplay("lean-replay",
+             cl::desc("While a state replays its received prefix, skip the offload "
+                      "readiness checks and poll timers and messages only every few "
+                      "instructions (default=off)"),
+             cl::init(false));
+
+  cl::opt<double>
+  ReadyReportInterval("ready-report-interval",
+                      cl::desc("Least seconds between two READY/NOT_READY messages of a "
+                               "worker, changes in between are folded into the next one "
+                               "(default=0 (report every change))"),
+                      cl::init(0.));
+
+  cl::opt<double>
+  ShareCoverageInterval("share-coverage-interval",
+                        cl::desc("Seconds between two exchanges of the covered "
+                                 "instructions with -share-coverage (default=2)"),
+                        cl::init(2.));
+
+  //a u32-length-prefixed plain prefix packet, as in NEW_TASK batches
+  template<typename InputIt>
+  void appendPrefixTask(std::vector<char> &batch, InputIt begin, InputIt end) {
+    PrefixPacket packet;
+    packet.common = PackedBranchHist(begin, end);
+    std::vector<char> encoded;
+    packet.encode(encoded);
+    uint32_t len = encoded.size();
+    const char *p = (const char *) &len;
+    batch.insert(batch.end(), p, p + sizeof(len));
+    batch.insert(batch.end(), encoded.begin(), encoded.end());
+  }
+
+  RecoveryProfile::SliceKey getSliceKey(const ref<RecoveryInfo> &ri) {
+    return std::make_pair((const Function *) ri->f, ri->sliceId);
+  }
 }
 
 
+cl::opt<bool>
+P2PSteal("p2p-steal",
+         cl::desc("With -lb, idle workers steal work directly from their peers "
+                  "and the master only detects termination (default=off)"),
+         cl::init(false));
+
+cl::opt<unsigned>
+LocalStealAttempts("local-steal-attempts",
+                   cl::desc("With -p2p-steal, steals tried on workers of the same node "
+                            "before one on another node (default=4, 0 ignores the nodes)"),
+                   cl::init(4));
+
+cl::opt<std::string>
+OffloadPolicyName("offloadPolicy",
+                  cl::desc("States given away on an offload request: DEFAULT, "
+                           "SHALLOW, COST or ADAPTIVE (default=DEFAULT)"),
+                  cl::value_desc("policy name"),
+                  cl::init("DEFAULT"));
+
+cl::opt<bool>
+PipelinePhase1("pipeline-phase1",
+               cl::desc("Send frontier states to idle workers while phase 1 is still "
+                        "expanding the tree (default=off)"),
+               cl::init(false));
+
+//prefix tasks the master already sent to ranks 2.. during phase 1
+unsigned Phase1StreamedTasks = 0;
+
+cl::opt<std::string>
+CheckpointFile("checkpoint",
+               cl::desc("Write the unexplored prefixes of the run to this file every "
+                        "-checkpoint-interval seconds and before a timeout, for "
+                        "-restart-from"),
+               cl::init(""));
+
+cl::opt<unsigned>
+SuspendedStateBudget("suspended-state-budget",
+                     cl::desc("Megabytes of offloaded states a worker keeps suspended for a "
+                              "later resume, past it the oldest are dropped and rebuilt by "
+                              "prefix replay (default=0 (no limit))"),
+                     cl::init(0));
+
 namespace klee {
   RNG theRNG;
+
+  namespace stats {
+    //see -suspended-state-budget
+    Statistic suspendedStateBytesPeak("SuspendedStateBytesPeak", "SSPeak");
+    Statistic evictedSuspendedStates("EvictedSuspendedStates", "SSEvict");
+    Statistic recoveryMemoHits("RecoveryMemoHits", "RMHits");
+    //bytes of every snapshot taken, freed ones are not subtracted
+    Statistic snapshotBytesTotal("SnapshotBytesTotal", "SnapBytes");
+    //states dropped over -max-memory whose path is replayed later
+    Statistic memoryEvictedStates("MemoryEvictedStates", "MemEvict");
+    //see -split-bounded-states
+    Statistic splitTasks("SplitTasks", "Split");
+    //instructions other ranks covered first, see -share-coverage
+    Statistic importedCoverage("ImportedCoverage", "CovImp");
+    //instructions run inside a received prefix
+    Statistic replayedInstructions("ReplayedInstructions", "RepInst");
+  }
 }
 
 const char *Executor::TerminateReasonNames[] = {
@@ -396,9 +557,12 @@ Executor::Executor(InterpreterOptions &opts, InterpreterHandler *ih)
       externalDispatcher(new ExternalDispatcher()), statsTracker(0),
       pathWriter(0), symPathWriter(0), specialFunctionHandler(0),
       processTree(0), replayKTest(0), replayPath(0), usingSeeds(0),
-      atMemoryLimit(false), inhibitForking(false), haltExecution(false),
+      atMemoryLimit(false), memoryCheckDue(false), coverageShareDue(false),
+      deferPolls(false),
+      inhibitForking(false),
+      haltExecution(false),
       ivcEnabled(false), enableBranchHalt(false), haltFromMaster(false),
-      ready2Offload(false),
+      ready2Offload(false), readyReported(false), lastReadyReport(0),
       coreSolverTimeout(MaxCoreSolverTime != 0 && MaxInstructionTime != 0
                             ? std::min(MaxCoreSolverTime, MaxInstructionTime)
                             : std::max(MaxCoreSolverTime, MaxInstructionTime)),
@@ -468,7 +632,25 @@ Executor::Executor(InterpreterOptions &opts, InterpreterHandler *ih)
   enableLB = false;
   numOffloadStates = 0;
   numPrefixes = 1;
+  coreInitialized = false;
+  tasksAcquired = 0;
+  pendingStealAcks = 0;
+  lastVictim = -1;
+  localStealTries = 0;
+  offloadIdleHint = 1;
+  offloadDonorHint = 1;
+  deepestExitDepth = 0;
+  suspendedStateBytes = 0;
+  brhistWriter = 0;
+  numBoundedTasks = 0;
+  offloadPolicy = OffloadPolicy::create(OffloadPolicyName);
+  if (!offloadPolicy)
+    klee_error("unknown offload policy %s", OffloadPolicyName.c_str());
+  upperBound = NULL;
+  lowerBound = NULL;
+  prefixDepth = 0;
   MPI_Comm_rank(MPI_COMM_WORLD, &coreId);
+  coordinator = theNodeTopology ? theNodeTopology->getCoordinator() : MASTER_NODE;
 }
 
 const Module *Executor::setModule(llvm::Module *module, const ModuleOptions &opts) {
@@ -532,6 +714,8 @@ Executor::~Executor() {
   if (statsTracker)
     delete statsTracker;
   delete solver;
+  delete offloadPolicy;
+  delete brhistWriter;
   /* TODO: is it the right place? */
   if (sliceGenerator) delete sliceGenerator;
   if (cloner) delete cloner;
@@ -867,7 +1051,8 @@ int Executor::branch(ExecutionState &state,
           //printPath(upperBound, mylogFile, "Upper bound: ");
         }  
 				for(int xid=result[0]->depth-1; xid<result[i]->depth; xid++) {
-					if(upperBound[xid] != result[i]->branchHist[xid]) {
+					//the live bound, acceptPrefixPacket moves it for resumed states
+					if(!upperBound || (unsigned) xid >= prefixDepth || upperBound[xid] != result[i]->branchHist[xid]) {
 						match = false;
 						break;	
 					}
@@ -1036,6 +1221,29 @@ int Executor::branch(ExecutionState &state,
   return result.size();
 }
 
+//branch queries go through the cache shared by the ranks when it is on,
+//sibling partitions and prefix replays keep asking the same ones
+bool Executor::evaluateBranch(ExecutionState &state, ref<Expr> condition,
+                              Solver::Validity &res, double timeout) {
+  bool cached = theSharedQueryCache && !isa<ConstantExpr>(condition);
+  SharedQueryCache::Fingerprint fp = { 0, 0 };
+  if (cached) {
+    fp = theSharedQueryCache->hashQuery(state.constraints, condition);
+    if (theSharedQueryCache->lookup(fp, res))
+      return true;
+  }
+  uint64_t start = theEventTrace ? theEventTrace->now() : 0;
+  solver->setTimeout(timeout);
+  bool success = solver->evaluate(state, condition, res);
+  solver->setTimeout(0);
+  if (theEventTrace)
+    theEventTrace->addSolverTime(theEventTrace->now() - start);
+  //an Unknown under a timeout may only mean a side was not decided in time
+  if (success && cached && !(res == Solver::Unknown && timeout))
+    theSharedQueryCache->insert(fp, res);
+  return success;
+}
+
 Executor::StatePair 
 Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
   Solver::Validity res;
@@ -1085,9 +1293,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       mylogFile.flush();
     }
 
-    solver->setTimeout(timeout);
-    bool success = solver->evaluate(current, condition, res);
-    solver->setTimeout(0);
+    bool success = evaluateBranch(current, condition, res, timeout);
     if (!success) {
       current.pc = current.prevPC;
       terminateStateEarly(current, "Query timed out (fork).");
@@ -1117,9 +1323,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       }
       if(isInternal) {
         //check to see if execution would have forked without the test  
-        solver->setTimeout(timeout);
-        bool success = solver->evaluate(current, condition, res);
-        solver->setTimeout(0);
+        bool success = evaluateBranch(current, condition, res, timeout);
         if(!success) {
           current.pc = current.prevPC;
           terminateStateEarly(current, "Query timed out (fork).");
@@ -1133,9 +1337,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
         //else res = Solver::False;
       }
     } else {
-      solver->setTimeout(timeout);
-      bool success = solver->evaluate(current, condition, res);
-      solver->setTimeout(0);
+      bool success = evaluateBranch(current, condition, res, timeout);
       if (!success) {
         current.pc = current.prevPC;
         terminateStateEarly(current, "Query timed out (fork).");
@@ -1451,6 +1653,8 @@ void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
       llvm::report_fatal_error("attempt to add invalid constraint");
     return;
   }
+  if (InternConstraints)
+    condition = exprTable.intern(condition);
 
   // Check to see if this constraint violates seeds.
   std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it = 
@@ -3110,94 +3314,142 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 }
 
+bool Executor::buildOffloadPacket(std::vector<char> &pkt2Send) {
+	std::vector<ExecutionState*> states2Offload;
+	int minSize = offloadFromStatesVector(states2Offload);
+	if(states2Offload.empty()) {
+		return false;
+	}
+
+	PrefixPacket packet;
+	for(int x=0; x<minSize; x++) {
+		int val = ((states2Offload[0])->branchHist)[x];
+		bool match = true;
+		for(int y=1; y<states2Offload.size(); y++) {
+			if(val != ((states2Offload[y])->branchHist)[x]) {
+				match = false;
+				break;
+			}
+		}
+		if(match) {
+			packet.common.push_back(val);
+		} else {
+			break;
+		}
+	}
+	if(ENABLE_OFFLOAD_LOGGING) {
+		mylogFile<<"Common Prefix Length: "<<packet.common.size()<<"\n";
+	}
+
+	//now add the per state suffixes
+	int start = packet.common.size();
+	packet.suffixes.resize(states2Offload.size());
+	for(int x=0; x<states2Offload.size(); x++) {
+		packet.suffixes[x] = PackedBranchHist(states2Offload[x]->branchHist.begin() + start,
+			states2Offload[x]->branchHist.end());
+	}
+
+	packet.encode(pkt2Send);
+	if(ENABLE_OFFLOAD_LOGGING) {
+		mylogFile<<"Packet Size: "<<pkt2Send.size()<<" Suffixes: "<<packet.suffixes.size()<<"\n";
+		mylogFile.flush();
+	}
+
+	//the offloaded states stay suspended here
+	searcher->update(nullptr, std::vector<ExecutionState *>(), states2Offload);
+	for(auto it=states2Offload.begin(); it!=states2Offload.end(); ++it) {
+		auto ii = states.find(*it);
+		assert(ii != states.end()); //can not be case as the state has to exist
+		states.erase(ii); //remove the state from states vector
+	
+		rangingSuspendedStates.push_back(*it);
+		auto hit = std::find(removedStates.begin(), removedStates.end(), *it);
+		if(hit != removedStates.end()) {
+			removedStates.erase(hit);
+		}
+	}
+	return true;
+}
+
+//the request carries the number of idle ranks and of donors being asked
+void Executor::recvOffloadRequest() {
+	uint32_t hint[2];
+	MPI_Status status;
+	MPI_Recv(hint, sizeof(hint), MPI_CHAR, coordinator, OFFLOAD, MPI_COMM_WORLD, &status);
+	offloadIdleHint = hint[0];
+	offloadDonorHint = hint[1];
+	if(theEventTrace) theEventTrace->record(EventTrace::OffloadRequest, coordinator);
+}
+
+//the coordinator keeps one small receive posted per worker, so the reply only
+//carries the packet length and the packet follows under its own tag
+void Executor::sendOffloadPacket(const std::vector<char> &pkt2Send) {
+	uint32_t len = pkt2Send.size();
+	if(theEventTrace) theEventTrace->record(EventTrace::OffloadResponse, coordinator, len);
+	MPI_Send(&len, sizeof(len), MPI_CHAR, coordinator, OFFLOAD_RESP, MPI_COMM_WORLD);
+	MPI_Send(&pkt2Send[0], len, MPI_CHAR, coordinator, OFFLOAD_PKT, MPI_COMM_WORLD);
+}
+
 void Executor::newCheck2Offload() {
 	int flag;
 	MPI_Status status;
-	MPI_Iprobe(MASTER_NODE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+
+	//serve a peer that tries to steal from us directly
+	if(P2PSteal) {
+		MPI_Iprobe(MPI_ANY_SOURCE, STEAL_REQ, MPI_COMM_WORLD, &flag, &status);
+		if(flag) {
+			char buffer;
+			int thief = status.MPI_SOURCE;
+			MPI_Recv(&buffer, 1, MPI_CHAR, thief, STEAL_REQ, MPI_COMM_WORLD, &status);
+			if(theEventTrace) theEventTrace->record(EventTrace::OffloadRequest, thief);
+			//one thief, one donor
+			offloadIdleHint = 1;
+			offloadDonorHint = 1;
+			std::vector<char> pkt2Send;
+			if(!haltExecution && buildOffloadPacket(pkt2Send)) {
+				//the master hears of the grant before our own FINISH, so it
+				//never sees every rank idle while the stolen work is in flight.
+				//The thief waits for the master's STEAL_ACK before its FINISH
+				int32_t granted = thief;
+				MPI_Send(&granted, sizeof(granted), MPI_CHAR, MASTER_NODE, STEAL_GRANTED, MPI_COMM_WORLD);
+				MPI_Send(&pkt2Send[0], pkt2Send.size(), MPI_CHAR, thief, STEAL_RESP, MPI_COMM_WORLD);
+				if(theEventTrace) theEventTrace->record(EventTrace::OffloadResponse, thief, pkt2Send.size());
+				if(ENABLE_OFFLOAD_LOGGING) {
+					mylogFile << "Stolen by: "<<thief<<" Packet Size: "<<pkt2Send.size()<<"\n";
+					mylogFile.flush();
+				}
+			} else {
+				char stealFailed = 'x';
+				MPI_Send(&stealFailed, 1, MPI_CHAR, thief, STEAL_RESP, MPI_COMM_WORLD);
+				if(theEventTrace) theEventTrace->record(EventTrace::OffloadResponse, thief);
+			}
+		}
+	}
+
+	MPI_Iprobe(coordinator, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
 	waiting4OffloadReq = true;
 	if(flag) {
 		if(status.MPI_TAG == OFFLOAD) {
-			int count;
-			char buffer;
-			MPI_Get_count(&status, MPI_CHAR, &count);
-			MPI_Recv(&buffer, count, MPI_CHAR, MASTER_NODE, OFFLOAD, MPI_COMM_WORLD, &status);
+			recvOffloadRequest();
 			if(ENABLE_OFFLOAD_LOGGING) {
 				mylogFile << "Offload Request\n";
 				mylogFile.flush();
 			}
-			bool valid;
-			std::vector<ExecutionState*> states2Offload;
-			int minSize = offloadFromStatesVector(states2Offload);
-				
-			//found some states
-			if(states2Offload.size() > 0) {
-				std::vector<unsigned char> commonPref;
-				for(int x=0; x<minSize; x++) {
-					int val = ((states2Offload[0])->branchHist)[x];
-					bool match = true;
-					for(int y=1; y<states2Offload.size(); y++) {
-						if(val != ((states2Offload[y])->branchHist)[x]) {
-							match = false;
-							break;
-						}
-					}
-					if(match) {
-						commonPref.push_back(val);
-					} else {
-						break;
-					}
-				}
-				if(ENABLE_OFFLOAD_LOGGING) {
-					mylogFile<<"Common Prefix Length: "<<commonPref.size()<<"\n";
-				}
-
-				//now combine the prefixes
-				//commonPref.push_back('-');
-				int start = commonPref.size();
-				for(int x=0; x<states2Offload.size(); x++) {
-					commonPref.push_back('-');
-					for(int y=start; y<states2Offload[x]->branchHist.size(); y++) {
-						commonPref.push_back(states2Offload[x]->branchHist[y]);
-					}
-				}
-	
-				if(ENABLE_OFFLOAD_LOGGING) {
-					mylogFile<<"Combined Prefix Length: "<<commonPref.size()<<"\n";
-					mylogFile<<"Prefix: ";
-					for(int x=0; x<commonPref.size(); x++) {
-						mylogFile<<commonPref[x];
-					}
-					mylogFile<<"\n";
-					mylogFile.flush();
-				}
-	
-				char* pkt2Send = (char*)malloc(commonPref.size()*sizeof(char));
-				for(int x=0; x<commonPref.size(); x++) {
-					pkt2Send[x] = commonPref[x];
-				}
-				//if(ENABLE_LOGGING) printPath(pkt2Send, mylogFile, "Packet to Send: ");
-				MPI_Send(pkt2Send, commonPref.size(), MPI_CHAR, 0, OFFLOAD_RESP, MPI_COMM_WORLD);
-
-				searcher->update(nullptr, std::vector<ExecutionState *>(), states2Offload);
-				for(auto it=states2Offload.begin(); it!=states2Offload.end(); ++it) {
-					auto ii = states.find(*it);
-					assert(ii != states.end()); //can not be case as the state has to exist
-					states.erase(ii); //remove the state from states vector
-				
-					rangingSuspendedStates.push_back(*it);
-					auto hit = std::find(removedStates.begin(), removedStates.end(), *it);
-					if(hit != removedStates.end()) {
-						removedStates.erase(hit);
-					}
-				}
+			std::vector<char> pkt2Send;
+			if(buildOffloadPacket(pkt2Send)) {
+				sendOffloadPacket(pkt2Send);
 			} else {
 				char offloadFailed = 'x';
-				MPI_Send(&offloadFailed, 1, MPI_CHAR, 0, OFFLOAD_RESP, MPI_COMM_WORLD);
+				MPI_Send(&offloadFailed, 1, MPI_CHAR, coordinator, OFFLOAD_RESP, MPI_COMM_WORLD);
+				if(theEventTrace) theEventTrace->record(EventTrace::OffloadResponse, coordinator);
 			}
 			waiting4OffloadReq = false;
+		} else if(status.MPI_TAG == CHECKPOINT) {
+			sendCheckpoint();
+		} else if(status.MPI_TAG == STEAL_ACK) {
+			recvStealAck();
 		} else if(status.MPI_TAG == KILL) {
-			char dummyRecv;
-			MPI_Recv(&dummyRecv, 1, MPI_CHAR, MASTER_NODE, KILL, MPI_COMM_WORLD, &status);
+			//left pending for the worker driver
 			haltExecution = true;
 			haltFromMaster = true;
 		}
@@ -3207,14 +3459,11 @@ void Executor::newCheck2Offload() {
 void Executor::check2Offload() {
   int flag;
   MPI_Status status;
-  MPI_Iprobe(MASTER_NODE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+  MPI_Iprobe(coordinator, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
   waiting4OffloadReq = true;
 	if(flag) {
   	if(status.MPI_TAG == OFFLOAD) {
-    	int count;
-      char buffer;
-    	MPI_Get_count(&status, MPI_CHAR, &count);
-    	MPI_Recv(&buffer, count, MPI_CHAR, MASTER_NODE, OFFLOAD, MPI_COMM_WORLD, &status);
+    	recvOffloadRequest();
     	if(ENABLE_LOGGING) {
         mylogFile << "Offload Request\n";
         mylogFile.flush();
@@ -3225,12 +3474,13 @@ void Executor::check2Offload() {
     	if(valid) {
         assert(state2Remove);
         //pathWriter->readStream(getPathStreamID(*state2Remove), packet2send);
-        char* pkt2Send = (char*)malloc(state2Remove->branchHist.size()*sizeof(char));
-        for(int x=0; x<state2Remove->branchHist.size();  x++) {
-          pkt2Send[x] = state2Remove->branchHist[x];
-        }
-        //if(ENABLE_LOGGING) printPath(pkt2Send, mylogFile, "Packet to Send: ");
-        MPI_Send(pkt2Send, state2Remove->branchHist.size(), MPI_CHAR, 0, OFFLOAD_RESP, MPI_COMM_WORLD);
+        //a single offloaded state is the common part plus one empty suffix
+        PrefixPacket packet;
+        packet.common = PackedBranchHist(state2Remove->branchHist.begin(), state2Remove->branchHist.end());
+        packet.suffixes.resize(1);
+        std::vector<char> pkt2Send;
+        packet.encode(pkt2Send);
+        sendOffloadPacket(pkt2Send);
         if(ENABLE_LOGGING) {
           mylogFile << "Offloading State Act Depth"<<state2Remove->actDepth<<" Prefix Depth: "<<state2Remove->depth<<"\n";
           mylogFile.flush();
@@ -3248,12 +3498,12 @@ void Executor::check2Offload() {
         }
    		} else {
         char offloadFailed = 'x';
-        MPI_Send(&offloadFailed, 1, MPI_CHAR, 0, OFFLOAD_RESP, MPI_COMM_WORLD);
+        MPI_Send(&offloadFailed, 1, MPI_CHAR, coordinator, OFFLOAD_RESP, MPI_COMM_WORLD);
+        if(theEventTrace) theEventTrace->record(EventTrace::OffloadResponse, coordinator);
       }
     	waiting4OffloadReq = false;
   	} else if(status.MPI_TAG == KILL) {
-      char dummyRecv;
-      MPI_Recv(&dummyRecv, 1, MPI_CHAR, MASTER_NODE, KILL, MPI_COMM_WORLD, &status);
+      //left pending for the worker driver
       haltExecution = true;
       haltFromMaster = true;
     }
@@ -3296,19 +3546,19 @@ void Executor::updateStates(ExecutionState *current) {
   
   states.insert(addedStates.begin(), addedStates.end());
   //numOffloadStates = numOffloadStates + addedStates.size();
+  for (std::vector<ExecutionState *>::iterator it = addedStates.begin(),
+         ie = addedStates.end(); it != ie; ++it)
+    forkStamps[*it] = stats::instructions;
 
 	//adding states to the suspended states prefix map
   for(auto it = rangingSuspendedStates.begin(); it != rangingSuspendedStates.end(); ++it) {
    	std::vector<unsigned char> recvP;
 		for(unsigned int x=0;x<((*it)->branchHist).size();x++) {
-  		//std::cout<<recv_prefix[x];
 			unsigned char dd = ((*it)->branchHist)[x];
   		if(dd == '2') {
     		recvP.push_back('0');
   		} else if(dd == '3') {
     		recvP.push_back('1');
-  		} else if(dd == '-') {
-    		continue;
   		} else {
     		recvP.push_back(dd);
   		}
@@ -3316,11 +3566,18 @@ void Executor::updateStates(ExecutionState *current) {
 
     (*it)->clearPrefixes();
  
-		//pathWriter->readStream(getPathStreamID(**it), suspendedStatePath);
-    std::string path(recvP.begin(), recvP.end());
-    prefixSuspendedStatesMap.insert(std::make_pair(path, *it));
+    std::string path = PackedBranchHist(recvP.begin(), recvP.end()).key();
+    if(prefixSuspendedStatesMap.insert(std::make_pair(path, *it)).second) {
+      uint64_t bytes = estimateStateBytes(*it);
+      suspendedStateSize[path] = bytes;
+      suspendedStateOrder.push_back(path);
+      suspendedStateBytes += bytes;
+    }
     prefixTree->addToTree(recvP);
   }
+  if(!rangingSuspendedStates.empty()) {
+    enforceSuspendedStateBudget();
+  }
 	
   addedStates.clear();
 	rangingSuspendedStates.clear();
@@ -3343,11 +3600,22 @@ void Executor::updateStates(ExecutionState *current) {
     if (it3 != seedMap.end())
       seedMap.erase(it3);
     processTree->remove(es->ptreeNode);
+    forkStamps.erase(es);
+    unmemoizableRecoveries.erase(es);
     delete es;
   }
   removedStates.clear();
   
-  if(enableLB) newCheck2Offload();
+  if(deferPolls) {
+    //-lean-replay, the next stride polls
+  } else if(enableLB) {
+    newCheck2Offload();
+  } else if(!CheckpointFile.empty() && coreId != MASTER_NODE) {
+    int flag;
+    MPI_Status status;
+    MPI_Iprobe(MASTER_NODE, CHECKPOINT, MPI_COMM_WORLD, &flag, &status);
+    if(flag) sendCheckpoint();
+  }
 }
 
 ExecutionState* Executor::offloadOriginatingStates(bool &valid) {
@@ -3391,48 +3659,39 @@ ExecutionState* Executor::offloadOriginatingStates(bool &valid) {
 }
 
 int Executor::offloadFromStatesVector(std::vector<ExecutionState*>& offloadVec) {
-	int minSize;	
+	int minSize = 0;
   if(!haltExecution && !haltFromMaster && ready2Offload) {
     assert(removedStates.size() == 0);
-		for(auto it=states.begin(); it!=states.end(); ++it) {
-			if(!(*it)->isSuspended()) {
-				if(offloadVec.size() == 0) {
-					minSize = (*it)->branchHist.size();
-				}	else {
-					if((*it)->branchHist.size() < minSize) {
-						minSize = (*it)->branchHist.size();
-					}
-				}
-				offloadVec.push_back(*it);
+		std::vector<ExecutionState*> pool;
+		searcher->getOffloadCandidates(OFFLOAD_CANDIDATE_LIMIT, pool);
+		std::vector<OffloadCandidate> candidates;
+		uint64_t now = stats::instructions;
+		for(auto it=pool.begin(); it!=pool.end(); ++it) {
+			OffloadCandidate c;
+			c.state = *it;
+			c.depth = (*it)->branchHist.size();
+			auto fit = forkStamps.find(*it);
+			c.instsSinceFork = (fit == forkStamps.end()) ? 0 : now - fit->second;
+			//every snapshot of a skipped function may have to be recovered
+			c.pendingRecoveries = (*it)->getSnapshots().size();
+			c.numConstraints = (*it)->constraints.size();
+			candidates.push_back(c);
+		}
+		//a worker stops at the phase 2 depth, without one the paths that
+		//ended so far tell how deep the tree goes
+		unsigned depthBound = explorationDepth > 0 ? explorationDepth : deepestExitDepth;
+		OffloadDecision d = offloadPolicy->select(candidates, offloadIdleHint, offloadDonorHint,
+		                                          depthBound);
+		offloadVec = d.states;
+		for(int x=0; x < offloadVec.size(); x++) {
+			if(x == 0 || (offloadVec[x]->branchHist).size() < minSize) {
+				minSize = (offloadVec[x]->branchHist).size();
 			}
-		}		
-		int numStates2Offload = 0;
-    if(offloadVec.size() < 4) {
-      offloadVec.clear();
-      return 0;
-    } else if(offloadVec.size() > 64) {
-      //numStates2Offload = offloadVec.size()/4;
-      numStates2Offload = 16;
-      offloadVec.erase(offloadVec.begin()+16, offloadVec.end());
-      minSize = (offloadVec[0]->branchHist).size();
-      for(int x=1; x < offloadVec.size(); x++) {
-        if((offloadVec[x]->branchHist).size() < minSize) {
-          minSize = (offloadVec[x]->branchHist).size();
-        }
-      }
-    } else {
-      numStates2Offload = offloadVec.size()/4;
-      offloadVec.erase(offloadVec.begin()+numStates2Offload, offloadVec.end());
-      minSize = (offloadVec[0]->branchHist).size();
-      for(int x=1; x < offloadVec.size(); x++) {
-        if((offloadVec[x]->branchHist).size() < minSize) {
-          minSize = (offloadVec[x]->branchHist).size();
-        }
-      }
-    }
+		}
 		if(ENABLE_OFFLOAD_LOGGING) {
-			mylogFile << "Number of states that are to be offloaded: "<<" "<<numStates2Offload
-        <<" "<<offloadVec.size()<<" "<<states.size()<<"\n";
+			mylogFile << "Number of states that are to be offloaded: "<<offloadVec.size()
+        <<" "<<candidates.size()<<" "<<states.size()<<" Work: "<<d.work
+        <<" Replay: "<<d.replayCost<<"\n";
 		}
 	}
 	if(ENABLE_OFFLOAD_LOGGING) {
@@ -3445,19 +3704,12 @@ ExecutionState* Executor::offloadFromStatesVector(bool &valid) {
   valid = false;
   if(!ready2Offload) { return NULL; }
   if(haltExecution || haltFromMaster) return NULL;
-  //look for the first non recovery and non suspended state
-  for(auto it=states.begin(); it!=states.end(); ++it) {
-    //if((*it)->isNormalState() && (!((*it)->isRecoveryState())) && 
-    if(!(*it)->isSuspended()) {
-      bool isRemoved=false;
-      for(auto it2=removedStates.begin(); it2!=removedStates.end(); ++it2) {
-        if(*it == *it2) {
-          isRemoved=true;
-          break;
-        }
-      }
-      if(isRemoved)
-        continue;
+  //the searcher only holds non suspended states, the ones terminated by
+  //this instruction are still there until updateStates
+  std::vector<ExecutionState*> pool;
+  searcher->getOffloadCandidates(removedStates.size() + 1, pool);
+  for(auto it=pool.begin(); it!=pool.end(); ++it) {
+    if(std::find(removedStates.begin(), removedStates.end(), *it) == removedStates.end()) {
       valid = true;
       return *it;
     }
@@ -3554,48 +3806,112 @@ void Executor::bindModuleConstants() {
   }
 }
 
+namespace {
+  //the memory usage is sampled on the timer rather than every so many
+  //instructions, GetTotalMallocUsage() is O(elts on freelist), and the
+  //coverage is exchanged the same way
+  class DueTimer : public Executor::Timer {
+    bool &due;
+
+  public:
+    DueTimer(bool &_due) : due(_due) {}
+
+    void run() { due = true; }
+  };
+}
+
 void Executor::checkMemoryUsage() {
-  if (!MaxMemory)
+  if (!memoryCheckDue)
     return;
-  if ((stats::instructions & 0xFFFF) == 0) {
-    // We need to avoid calling GetTotalMallocUsage() often because it
-    // is O(elts on freelist). This is really bad since we start
-    // to pummel the freelist once we hit the memory cap.
-    unsigned mbs = (util::GetTotalMallocUsage() >> 20) +
-                   (memory->getUsedDeterministicSize() >> 20);
-
-    if (mbs > MaxMemory) {
-      if (mbs > MaxMemory + 100) {
-        // just guess at how many to kill
-        unsigned numStates = states.size();
-        unsigned toKill = std::max(1U, numStates - numStates * MaxMemory / mbs);
-        klee_warning("killing %d states (over memory cap)", toKill);
-        std::vector<ExecutionState *> arr;
-        for (std::set<ExecutionState *>::iterator i = states.begin(); i != states.end(); i++) {
-          ExecutionState *toremove = *i;
-          if ((toremove->isNormalState() && toremove->isSuspended()) || toremove->isRecoveryState())  {
-            continue;
-          }
-          arr.push_back(toremove);
-        }
-        for (unsigned i = 0, N = arr.size(); N && i < toKill; ++i, --N) {
-          unsigned idx = rand() % N;
-          // Make two pulls to try and not hit a state that
-          // covered new code.
-          if (arr[idx]->coveredNew)
-            idx = rand() % N;
-
-          std::swap(arr[idx], arr[N - 1]);
-          terminateStateEarly(*arr[N - 1], "Memory limit exceeded.");
-        }
+  memoryCheckDue = false;
+
+  //the snapshots of dead lineages go before the memory is measured
+  if (RecoveryMemoization)
+    recoveryMemo.sweep();
+
+  unsigned mbs = (util::GetTotalMallocUsage() >> 20) +
+                 (memory->getUsedDeterministicSize() >> 20);
+  bool overLimit = mbs > MaxMemory;
+
+  //a loaded worker asks its coordinator to move states to other ranks
+  //first, with stealing the peers pick their victims themselves
+  if (coreId != MASTER_NODE && enableLB && !P2PSteal && prefixDepth != 0 &&
+      overLimit != atMemoryLimit) {
+    char pressure = overLimit;
+    MPI_Send(&pressure, 1, MPI_CHAR, coordinator, MEMORY_PRESSURE, MPI_COMM_WORLD);
+    if (ENABLE_LOGGING) {
+      mylogFile << (overLimit ? "MEMORY PRESSURE " : "MEMORY RELIEVED ") << mbs << "\n";
+      mylogFile.flush();
+    }
+  }
+  atMemoryLimit = overLimit;
+
+  if (mbs > MaxMemory + 100) {
+    // just guess at how many to kill
+    unsigned numStates = states.size();
+    unsigned toKill = std::max(1U, numStates - numStates * MaxMemory / mbs);
+    //workers replay the path of a dropped state once their states run out
+    bool evict = coreId != MASTER_NODE;
+    klee_warning("%s %d states (over memory cap)", evict ? "evicting" : "killing",
+                 toKill);
+    std::vector<ExecutionState *> arr;
+    for (std::set<ExecutionState *>::iterator i = states.begin(); i != states.end(); i++) {
+      ExecutionState *toremove = *i;
+      if ((toremove->isNormalState() && toremove->isSuspended()) || toremove->isRecoveryState())  {
+        continue;
       }
-      atMemoryLimit = true;
-    } else {
-      atMemoryLimit = false;
+      arr.push_back(toremove);
+    }
+    for (unsigned i = 0, N = arr.size(); N && i < toKill; ++i, --N) {
+      unsigned idx = rand() % N;
+      // Make two pulls to try and not hit a state that
+      // covered new code.
+      if (arr[idx]->coveredNew)
+        idx = rand() % N;
+
+      std::swap(arr[idx], arr[N - 1]);
+      if (evict)
+        evictStateToReplay(*arr[N - 1]);
+      else
+        terminateStateEarly(*arr[N - 1], "Memory limit exceeded.");
     }
   }
 }
 
+void Executor::shareCoverage() {
+  if (!coverageShareDue)
+    return;
+  coverageShareDue = false;
+
+  StatisticManager &sm = *theStatisticManager;
+  unsigned numIds = std::min(kmodule->infos->getMaxID(), theCoverageShare->size());
+  for (unsigned id = 0; id < numIds; ++id)
+    if (sm.getIndexedValue(stats::coveredInstructions, id))
+      theCoverageShare->markCovered(id);
+
+  std::vector<unsigned> learned;
+  theCoverageShare->exchange(learned);
+
+  //counted as covered here too, so stepping them is not new coverage and
+  //the distances to uncovered code skip them
+  unsigned imported = 0;
+  for (unsigned i = 0; i < learned.size(); ++i) {
+    unsigned id = learned[i];
+    if (id >= numIds || sm.getIndexedValue(stats::coveredInstructions, id))
+      continue;
+    sm.incrementIndexedValue(stats::coveredInstructions, id, 1);
+    if (sm.getIndexedValue(stats::uncoveredInstructions, id))
+      sm.incrementIndexedValue(stats::uncoveredInstructions, id, (uint64_t) -1);
+    ++imported;
+  }
+  if (!imported)
+    return;
+  stats::importedCoverage += imported;
+  if (statsTracker)
+    statsTracker->computeReachableUncovered();
+  searcher->coverageChanged();
+}
+
 void Executor::doDumpStates() {
   if (!DumpStatesOnHalt || states.empty())
     return;
@@ -3611,15 +3927,28 @@ void Executor::doDumpStates() {
 }
 
 void Executor::run(ExecutionState &initialState, bool branchLevelHalt, bool pathPrefix) {
-  bindModuleConstants();
+  //the module and timers stay resident across the tasks of a worker
+  if(!coreInitialized) {
+    bindModuleConstants();
 
-  // Delay init till now so that ticks don't accrue during
-  // optimization and such.
-  initTimers();
+    // Delay init till now so that ticks don't accrue during
+    // optimization and such.
+    initTimers();
+    if (MaxMemory)
+      addTimer(new DueTimer(memoryCheckDue), MEMORY_CHECK_RATE);
+    if (theCoverageShare)
+      addTimer(new DueTimer(coverageShareDue), ShareCoverageInterval);
+    coreInitialized = true;
+  }
 
   enableBranchHalt = branchLevelHalt;
+  haltFromMaster = false;
+  ready2Offload = false;
+  readyReported = false;
+  nonRecoveryStates.clear();
 
   states.insert(&initialState);
+  forkStamps[&initialState] = stats::instructions;
   nonRecoveryStates.insert(&initialState);
   initialState.setPrefix(upperBound);
   initialState.setPrefixDepth(prefixDepth);
@@ -3696,6 +4025,8 @@ void Executor::run(ExecutionState &initialState, bool branchLevelHalt, bool path
   }
 
   searcher = constructUserSearcher(*this, searchMode);
+  if (AdaptiveRecoverySplit)
+    searcher->enableAdaptiveSplit();
 
   std::vector<ExecutionState *> newStates(states.begin(), states.end());
   searcher->update(0, newStates, std::vector<ExecutionState *>());
@@ -3714,17 +4045,18 @@ void Executor::run(ExecutionState &initialState, bool branchLevelHalt, bool path
       //phase1depth in this case is the number of workers
       if(enableBranchHalt) {
         if(coreId == 0) {
-          cntNumStates2Offload = 0;
-          for(auto it = states.begin(); it != states.end(); ++it) {
-            if(!(*it)->isSuspended()) {
-              cntNumStates2Offload++;
-            }
-          }
-          if(cntNumStates2Offload >= branchLevel2Halt) {
+          //the tasks the frontier would make so far: the searcher counts
+          //its normal states as they come and go, suspended states are
+          //never handed to it and recovery states are not tasks
+          cntNumStates2Offload = searcher->getNumOffloadable();
+          if(cntNumStates2Offload + Phase1StreamedTasks >= branchLevel2Halt) {
             haltExecution = true;
             haltFromMaster = true;
             break;
           }
+          if(PipelinePhase1 && streamFrontierState(state)) {
+            continue;
+          }
         } 
 				else {
 					//removing states that have reached the termination depth but only do
@@ -3736,6 +4068,11 @@ void Executor::run(ExecutionState &initialState, bool branchLevelHalt, bool path
                 mylogFile<<"Removing State: "<<&state<<" "<<states.size()<<" "<<state.depth<<"\n";
                 mylogFile.flush();
               }
+              //a task always extends its prefix, so replaying it elsewhere
+              //cannot come back here
+              if(SplitBoundedStates && state.branchHist.size() > prefixDepth) {
+                queueBoundedTask(state);
+              }
 
               std::vector<ExecutionState *> remStates;
               remStates.push_back(&state);
@@ -3752,208 +4089,170 @@ void Executor::run(ExecutionState &initialState, bool branchLevelHalt, bool path
       }
       KInstruction *ki = state.pc;
       //printStatePath(state, std::cout, "Selected State Path: ");
+      bool inPrefix = state.shallIRange();
+      //-lean-replay: the prefix was explored by the sender, polls and
+      //readiness wait until the state leaves it
+      bool lean = LeanReplay && inPrefix;
+      if(inPrefix) ++stats::replayedInstructions;
       stepInstruction(state);
+      if(theEventTrace)
+        theEventTrace->countInstruction(inPrefix);
+      if(AdaptiveRecoverySplit) {
+        if(state.isRecoveryState())
+          recoveryProfile.onRecoveryInstruction(getSliceKey(state.getRecoveryInfo()));
+        else
+          recoveryProfile.onNormalInstruction();
+      }
       executeInstruction(state, ki);
-      processTimers(&state, MaxInstructionTime);
+      deferPolls = lean && (stats::instructions & (LEAN_REPLAY_POLL_STRIDE - 1)) != 0;
+      if(!deferPolls)
+        processTimers(&state, MaxInstructionTime);
       checkMemoryUsage();
+      if (theCoverageShare)
+        shareCoverage();
       updateStates(&state);
+      deferPolls = false;
+      if(AdaptiveRecoverySplit && (stats::instructions % RECOVERY_SPLIT_INTERVAL) == 0) {
+        searcher->setRecoveryRatio(recoveryProfile.getRecoveryShare(countPendingSuspended()));
+      }
 
 			//Look at the states size, and see if anything changes regards to 
 			//offload situation of this worker
-			if((coreId!=0) && enableLB && (prefixDepth!=0)) {
-  			char dummy;
-        numOffloadStates = searcher->getSize();
-  			if(ready2Offload && (numOffloadStates<OFFLOAD_NOT_READY_THRESH)) {
-    			//can not offload now
-    			MPI_Send(&dummy, 1, MPI_CHAR, 0, NOT_READY_TO_OFFLOAD, MPI_COMM_WORLD);
-    			ready2Offload=false;
-    			if(ENABLE_LOGGING) {
-      			mylogFile<<"NOT READY2OFF\n";
-      			mylogFile.flush();
-    			}
-  			} else if(!ready2Offload && (numOffloadStates>=OFFLOAD_READY_THRESH)) {
-    			//can offload now
-    			MPI_Send(&dummy, 1, MPI_CHAR, 0, READY_TO_OFFLOAD, MPI_COMM_WORLD);
-    			ready2Offload=true;
-    			if(ENABLE_LOGGING) {
-     				mylogFile<<"READY2OFF\n";
-      			mylogFile.flush();
-    			}
-  			}
+			if((coreId!=0) && enableLB && (prefixDepth!=0) && !lean) {
+        numOffloadStates = searcher->getNumOffloadable();
+        //states behind a cheap recovery will soon be offloadable again
+        if(AdaptiveRecoverySplit)
+          numOffloadStates += recoveryProfile.getExpectedResumes(countPendingSuspended());
+        bool ready = offloadPolicy->isReady(numOffloadStates, ready2Offload);
+        if(ready != ready2Offload) {
+          ready2Offload = ready;
+          if(theEventTrace)
+            theEventTrace->record(ready ? EventTrace::Ready : EventTrace::NotReady);
+          if(ENABLE_LOGGING) {
+            mylogFile<<(ready ? "READY2OFF\n" : "NOT READY2OFF\n");
+            mylogFile.flush();
+          }
+        }
+        //peers ask us directly when stealing, only the coordinator keeps a
+        //list. It hears the state at most once per -ready-report-interval,
+        //flips in between cancel out
+        if(!P2PSteal && ready2Offload != readyReported) {
+          double now = ReadyReportInterval ? util::getWallTime() : 0;
+          if(!ReadyReportInterval || now - lastReadyReport >= ReadyReportInterval) {
+            char dummy;
+            MPI_Send(&dummy, 1, MPI_CHAR, coordinator,
+                     ready2Offload ? READY_TO_OFFLOAD : NOT_READY_TO_OFFLOAD, MPI_COMM_WORLD);
+            readyReported = ready2Offload;
+            lastReadyReport = now;
+          }
+        }
 			}
     }
 
     if((coreId != 0) && (!haltFromMaster)) {
-      //tell the master the you have finished working on your prefix
+      //paths without a suspended ancestor are replayed from main
+      //before this worker reports itself idle
+      if(!pendingPrefixes.empty()) {
+        haltFromMaster = true;
+        haltExecution = true;
+        continue;
+      }
+
+      //tell the master the you have finished working on your prefix,
+      //with stealing once per task taken since the last report
       char result;
       if(ENABLE_LOGGING) {
         mylogFile << "Finish:  "<<coreId<<"\n";
         mylogFile.flush();
       }
-      MPI_Send(&result, 1, MPI_CHAR, 0, FINISH, MPI_COMM_WORLD);
-      //receive some message from the master
-      MPI_Status status;
-      MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-      int count;
-      MPI_Get_count(&status, MPI_CHAR, &count);
-      if(status.MPI_TAG == KILL) {
-        char dummy2;
-        MPI_Recv(&dummy2, 1, MPI_CHAR, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        //std::cout << "Killing Process: "<<coreId<<"\n";
-        haltFromMaster = true;
-        haltExecution = true;
-      } else if (status.MPI_TAG == START_PREFIX_TASK) {
-        char* recv_prefix;
-        recv_prefix = (char*)malloc(count*sizeof(char));
-        MPI_Recv(recv_prefix, count, MPI_CHAR, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        std::cout << "Process: "<<coreId<<" Prefix Task: Length:"<<count<<"\n";
-        if(ENABLE_LOGGING) {
-          mylogFile << "Process: "<<coreId<<" Prefix Task: Length:"<<count<<"\n";
-
-          if(ENABLE_OFFLOAD_LOGGING) {
-            for(int c=0; c<count; c++) {
-              mylogFile<<recv_prefix[c];  
-            }
-          }
-          mylogFile<<"\n";
-        }
-
-        setLowerBound(recv_prefix);
-        setUpperBound(recv_prefix);
-        enablePrefixChecking();
-				setTestPrefixDepth(count);
-
-        //first, conunt the hyphens
-        std::vector<int> dashLoc;
-        for(int x=0; x<count; x++) {
-          if(recv_prefix[x] == '-') {
-            if(ENABLE_OFFLOAD_LOGGING) {
-              mylogFile << "Found dash at : "<<x<<"\n";
-              mylogFile.flush();
-            }
-            dashLoc.push_back(x);
-          }
-        }
-        
-        std::vector<unsigned char> recvP;
-        std::vector<ExecutionState*> rangingResumedStates;
-        std::vector<std::string> resumePaths;
-
-        for(int pref=0; pref<dashLoc.size(); pref++) {
-          for(int loc=0; loc<dashLoc[0]; loc++) {
-            recvP.push_back(recv_prefix[loc]);
-          }
-          if(ENABLE_OFFLOAD_LOGGING) {
-            mylogFile << "Initial Size: "<<recvP.size()<<"\n";
-            mylogFile << "Doing offload at loc: "<<dashLoc[pref]<<"\n";
-          }
-          for(int pl=dashLoc[pref]+1; pl<count; pl++) {
-            if(recv_prefix[pl] == '-') {
-              if(ENABLE_OFFLOAD_LOGGING) {
-                mylogFile<<"Found terminating - at: "<<pl<<"\n";
-                mylogFile.flush();
-              }
-              break;
-            }
-            recvP.push_back(recv_prefix[pl]);
-          }
-
-          if(ENABLE_OFFLOAD_LOGGING) {
-            mylogFile<<"PPrefix: "<<recvP.size()<<"\n";
-            for(int c=0; c<recvP.size(); c++) {
-              mylogFile<<recvP[c];  
-            }
-            mylogFile.flush();
-            mylogFile<<"\n";
-          }
-
-          //coverting it to 101010... format
-          std::vector<unsigned char> resP;
-          for(unsigned int x=0;x<recvP.size();x++) {
-  					//std::cout<<recv_prefix[x];
-  					unsigned char dd = recvP[x];
-  					if(dd == '2') {
-    					resP.push_back('0');
-  					} else if(dd == '3') {
-    					resP.push_back('1');
-  					} else if(dd == '-') {
-    					continue;
-  					} else {
-              resP.push_back(dd);
-            }
-					}
-
-          std::vector<unsigned char> prefixToResume;
-          prefixTree->getPathToResume(resP, prefixToResume, mylogFile);
-          if(ENABLE_OFFLOAD_LOGGING) {
-            mylogFile << "Path to Resume: ";
-            for(unsigned int x=0;x<prefixToResume.size();x++) {
-              mylogFile<<prefixToResume[x];
-            }
-            mylogFile<<"\n";
-          }
-
-          std::string resumePath(prefixToResume.begin(), prefixToResume.end());
-          assert(prefixSuspendedStatesMap.find(resumePath) != prefixSuspendedStatesMap.end());
-          ExecutionState* resumedState = prefixSuspendedStatesMap[resumePath];
-          if(ENABLE_OFFLOAD_LOGGING) {
-            mylogFile << "Resume states prefix lists size: "<<resumedState->getPrefixesSize()<<"\n";
-            mylogFile.flush();
-          }
-
-          char* stPref = (char*)malloc(recvP.size()*sizeof(char));
-          for(int x=0; x<recvP.size(); x++) {
-            stPref[x] = recvP[x];
-          }
-          resumedState->addPrefix(stPref, recvP.size());
-          if(ENABLE_OFFLOAD_LOGGING) {
-            mylogFile<<"Adding prefix: "<<recvP.size()<<"\n";
-            mylogFile.flush();
-          }
-          
-          auto iu = std::find(rangingResumedStates.begin(), rangingResumedStates.end(),
-              resumedState);
-          if(iu == rangingResumedStates.end()) {
-            rangingResumedStates.push_back(resumedState);
-            resumePaths.push_back(resumePath);
-          }
+      if(ENABLE_OFFLOAD_LOGGING) {
+        offloadPolicy->printStats(mylogFile);
+        mylogFile.flush();
+      }
+      //the new tasks reach the master before the FINISH of their parent
+      flushBoundedTasks();
+      //a stolen task is only counted once the master heard of the grant
+      while(pendingStealAcks)
+        recvStealAck();
+      unsigned numFinish = (P2PSteal && enableLB) ? tasksAcquired : 1;
+      for(unsigned x=0; x<numFinish; ++x) {
+        MPI_Send(&result, 1, MPI_CHAR, coordinator, FINISH, MPI_COMM_WORLD);
+      }
+      if(theEventTrace) theEventTrace->record(EventTrace::TaskFinish, 0, numFinish);
+      tasksAcquired = 0;
 
-          recvP.clear();
-        }
+      if(P2PSteal && enableLB) {
+        stealWork();
+        continue;
+      }
 
-        if(ENABLE_OFFLOAD_LOGGING) {
-          mylogFile << "Number of states ot resume: "<<rangingResumedStates.size()<<"\n";
-          mylogFile.flush();
-          for(int jj=0; jj<rangingResumedStates.size(); ++jj) {
-            mylogFile<<"resume state prefix list: "<<rangingResumedStates[jj]->getPrefixesSize()<<" State depth: "
-              <<rangingResumedStates[jj]->depth<<"\n";
-            mylogFile.flush();
-          }
+      //wait for the next task or the KILL, a request that crossed our
+      //FINISH is answered without reporting the FINISH again
+      bool idle = true;
+      while(idle) {
+        MPI_Status status;
+        {
+          EventTraceSpan idleSpan(EventTrace::Idle);
+          MPI_Probe(coordinator, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
         }
-        
-        states.insert(rangingResumedStates.begin(), rangingResumedStates.end());
-        std::vector<ExecutionState *> resumedStates(states.begin(), states.end());
-        searcher->update(0, resumedStates, std::vector<ExecutionState *>());
-        for(auto hh = resumePaths.begin(); hh != resumePaths.end(); ++hh) {
-          prefixSuspendedStatesMap.erase(*hh);
+        int count;
+        MPI_Get_count(&status, MPI_CHAR, &count);
+        if(status.MPI_TAG == KILL) {
+          //left pending, the worker driver consumes it and tears down
+          haltFromMaster = true;
+          haltExecution = true;
+          idle = false;
+        } else if(status.MPI_TAG == OFFLOAD) {
+          //nothing left to give
+          char offloadFailed = 'x';
+          recvOffloadRequest();
+          MPI_Send(&offloadFailed, 1, MPI_CHAR, coordinator, OFFLOAD_RESP, MPI_COMM_WORLD);
+          if(theEventTrace) theEventTrace->record(EventTrace::OffloadResponse, coordinator);
+        } else if(status.MPI_TAG == CHECKPOINT) {
+          //crossed our FINISH as well, the frontier is empty
+          sendCheckpoint();
+        } else if (status.MPI_TAG == START_PREFIX_TASK) {
+          char* recv_prefix;
+          recv_prefix = (char*)malloc(count*sizeof(char));
+          MPI_Recv(recv_prefix, count, MPI_CHAR, coordinator, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+          std::cout << "Process: "<<coreId<<" Prefix Task: Length:"<<count<<"\n";
+          acceptPrefixPacket(recv_prefix, count);
+          free(recv_prefix);
+          idle = false;
         }
-
-        rangingResumedStates.clear();
-        resumePaths.clear();
       }
     }
   }
-	
 	//here empty out all the states into the worklist
+	//largest estimated subtree first, so the longest tasks start first
 	if(enableBranchHalt && (coreId==0)) {
-    workList = (char **)malloc(cntNumStates2Offload*sizeof(char*));
-    unsigned int stateNum=0;
+    std::vector<ExecutionState*> frontier;
+    unsigned maxDepth = 0;
     for(auto it=states.begin(); it!=states.end(); ++it) {
       if(!(*it)->isSuspended()) {
-        addState2WorkList(**it,stateNum);
-        stateNum++;
+        frontier.push_back(*it);
+        maxDepth = std::max(maxDepth, (unsigned) (*it)->branchHist.size());
+      }
+    }
+    std::vector<std::pair<double, ExecutionState*> > ranked;
+    for(auto it=frontier.begin(); it!=frontier.end(); ++it) {
+      ranked.push_back(std::make_pair(-estimateSubtreeCost(**it, maxDepth), *it));
+    }
+    std::stable_sort(ranked.begin(), ranked.end(),
+        [](const std::pair<double, ExecutionState*> &a,
+           const std::pair<double, ExecutionState*> &b) { return a.first < b.first; });
+
+    cntNumStates2Offload = ranked.size();
+    workList = (char **)malloc(cntNumStates2Offload*sizeof(char*));
+    for(unsigned int stateNum=0; stateNum<ranked.size(); stateNum++) {
+      addState2WorkList(*ranked[stateNum].second, stateNum);
+      //checked against the TASK_COST lines of the master log
+      if(ENABLE_LOGGING) {
+        mylogFile << "Worklist Task: "<<stateNum<<" Estimate: "<<-ranked[stateNum].first
+          <<" Depth: "<<ranked[stateNum].second->branchHist.size()<<"\n";
       }
     }
+    if(ENABLE_LOGGING) mylogFile.flush();
 	}
 	
   delete searcher;
@@ -3961,14 +4260,234 @@ void Executor::run(ExecutionState &initialState, bool branchLevelHalt, bool path
   
 }
 
-bool Executor::addState2WorkList(ExecutionState &state, int count) {
+void Executor::acceptPrefixPacket(const char* buf, unsigned size) {
+  PrefixPacket packet;
+  if(!packet.decode(buf, size)) {
+    //refused as a task with nothing to explore, the FINISH still goes out
+    klee_warning("process %d: dropping a malformed prefix task of %u bytes",
+                 coreId, size);
+    ++tasksAcquired;
+    haltFromMaster = true;
+    haltExecution = true;
+    return;
+  }
+  if(ENABLE_LOGGING) {
+    mylogFile << "Process: "<<coreId<<" Prefix Task: Common:"<<packet.common.size()
+      <<" Suffixes: "<<packet.suffixes.size()<<"\n";
+  }
+  ++tasksAcquired;
+  if(theEventTrace) theEventTrace->record(EventTrace::TaskStart, 0, 1);
+
+  //a plain prefix (phase 1 worklist) has no suspended state here,
+  //hand it back to runFunctionAsMain2 to replay it from main
+  if(packet.suffixes.empty()) {
+    adoptPrefix(packet);
+    haltFromMaster = true;
+    haltExecution = true;
+    return;
+  }
+
+  std::vector<unsigned char> recvP;
+  std::vector<ExecutionState*> rangingResumedStates;
+  std::vector<std::string> resumePaths;
+
+  for(int pref=0; pref<packet.suffixes.size(); pref++) {
+    packet.getPath(pref, recvP);
+
+    if(ENABLE_OFFLOAD_LOGGING) {
+      mylogFile<<"PPrefix: "<<recvP.size()<<"\n";
+      for(int c=0; c<recvP.size(); c++) {
+        mylogFile<<recvP[c];  
+      }
+      mylogFile.flush();
+      mylogFile<<"\n";
+    }
+
+    //coverting it to 101010... format
+    std::vector<unsigned char> resP;
+    for(unsigned int x=0;x<recvP.size();x++) {
+      unsigned char dd = recvP[x];
+      if(dd == '2') {
+        resP.push_back('0');
+      } else if(dd == '3') {
+        resP.push_back('1');
+      } else {
+        resP.push_back(dd);
+      }
+    }
+
+    if(!searcher || prefixSuspendedStatesMap.empty()) {
+      pendingPrefixes.push_back(recvP);
+      continue;
+    }
+
+    std::vector<unsigned char> prefixToResume;
+    prefixTree->getPathToResume(resP, prefixToResume, mylogFile);
+    if(ENABLE_OFFLOAD_LOGGING) {
+      mylogFile << "Path to Resume: ";
+      for(unsigned int x=0;x<prefixToResume.size();x++) {
+        mylogFile<<prefixToResume[x];
+      }
+      mylogFile<<"\n";
+    }
+
+    std::string resumePath = PackedBranchHist(prefixToResume.begin(), prefixToResume.end()).key();
+    auto sit = prefixSuspendedStatesMap.find(resumePath);
+    //the tree still holds evicted paths, fall back to the deepest live
+    //ancestor before replaying from main
+    for(size_t len = prefixToResume.size(); sit == prefixSuspendedStatesMap.end() && len > 0; --len) {
+      resumePath = PackedBranchHist(prefixToResume.begin(), prefixToResume.begin() + (len-1)).key();
+      sit = prefixSuspendedStatesMap.find(resumePath);
+    }
+    if(sit == prefixSuspendedStatesMap.end()) {
+      pendingPrefixes.push_back(recvP);
+      continue;
+    }
+    ExecutionState* resumedState = sit->second;
+    if(ENABLE_OFFLOAD_LOGGING) {
+      mylogFile << "Resume states prefix lists size: "<<resumedState->getPrefixesSize()<<"\n";
+      mylogFile.flush();
+    }
+
+    char* stPref = (char*)malloc(recvP.size()*sizeof(char));
+    for(int x=0; x<recvP.size(); x++) {
+      stPref[x] = recvP[x];
+    }
+    resumedState->addPrefix(stPref, recvP.size());
+    if(ENABLE_OFFLOAD_LOGGING) {
+      mylogFile<<"Adding prefix: "<<recvP.size()<<"\n";
+      mylogFile.flush();
+    }
+
+    //the bounds follow the last received path
+    if(pref == packet.suffixes.size()-1) {
+      setLowerBound(stPref);
+      setUpperBound(stPref);
+      enablePrefixChecking();
+      setTestPrefixDepth(recvP.size());
+    }
+    
+    auto iu = std::find(rangingResumedStates.begin(), rangingResumedStates.end(),
+        resumedState);
+    if(iu == rangingResumedStates.end()) {
+      rangingResumedStates.push_back(resumedState);
+      resumePaths.push_back(resumePath);
+    }
+
+    recvP.clear();
+  }
+
+  if(ENABLE_OFFLOAD_LOGGING) {
+    mylogFile << "Number of states ot resume: "<<rangingResumedStates.size()<<"\n";
+    mylogFile.flush();
+    for(int jj=0; jj<rangingResumedStates.size(); ++jj) {
+      mylogFile<<"resume state prefix list: "<<rangingResumedStates[jj]->getPrefixesSize()<<" State depth: "
+        <<rangingResumedStates[jj]->depth<<"\n";
+      mylogFile.flush();
+    }
+  }
+  
+  //nothing could be resumed, replay the queued paths from main
+  if(rangingResumedStates.empty()) {
+    haltFromMaster = true;
+    haltExecution = true;
+    return;
+  }
+  states.insert(rangingResumedStates.begin(), rangingResumedStates.end());
+  std::vector<ExecutionState *> resumedStates(states.begin(), states.end());
+  searcher->update(0, resumedStates, std::vector<ExecutionState *>());
+  for(auto hh = resumePaths.begin(); hh != resumePaths.end(); ++hh) {
+    prefixSuspendedStatesMap.erase(*hh);
+    auto bit = suspendedStateSize.find(*hh);
+    if(bit != suspendedStateSize.end()) {
+      suspendedStateBytes -= bit->second;
+      suspendedStateSize.erase(bit);
+    }
+  }
+}
+
+//hands the oldest waiting state of the DFS frontier to the next worker
+//that has not been seeded yet, the master never explores it
+bool Executor::streamFrontierState(ExecutionState &current) {
+  int numRanks;
+  MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+  //with groups the prefixes go through the coordinators
+  if((int) Phase1StreamedTasks + 2 >= numRanks || !searcher->atleast2states() ||
+     theNodeTopology->hasGroups()) {
+    return false;
+  }
+  ExecutionState *es = searcher->getState2Offload();
+  if(es == &current || !es->isNormalState() || es->isRecoveryState() ||
+     es->isSuspended() || es->branchHist.empty()) {
+    return false;
+  }
+
+  PrefixPacket packet;
+  packet.common = PackedBranchHist(es->branchHist.begin(), es->branchHist.end());
+  std::vector<char> bytes;
+  packet.encode(bytes);
+  int rank = 2 + Phase1StreamedTasks++;
+  MPI_Send(&bytes[0], bytes.size(), MPI_CHAR, rank, START_PREFIX_TASK, MPI_COMM_WORLD);
+  if(ENABLE_LOGGING) {
+    mylogFile << "Streamed prefix to: "<<rank<<" Depth: "<<es->branchHist.size()<<"\n";
+    mylogFile.flush();
+  }
+
+  std::vector<ExecutionState *> remStates;
+  remStates.push_back(es);
+  searcher->update(nullptr, std::vector<ExecutionState *>(), remStates);
+  states.erase(es);
+  nonRecoveryStates.erase(es);
+  seedMap.erase(es);
+  forkStamps.erase(es);
+  processTree->remove(es->ptreeNode);
+  delete es;
+  return true;
+}
 
-  char* newPath = (char*)malloc(state.branchHist.size()*sizeof(char));
-  for (int I = 0; I < state.branchHist.size(); ++I) {
-    newPath[I] = state.branchHist[I];
+//cost of the subtree below a phase 1 frontier state: the levels left under
+//the deepest frontier state, priced by the instructions run since the last
+//fork and scaled up by how much the code around the state forks and by the
+//recoveries still to come
+double Executor::estimateSubtreeCost(ExecutionState &es, unsigned maxDepth) {
+  double levels = maxDepth - es.branchHist.size() + 1;
+  auto fit = forkStamps.find(&es);
+  double instsSinceFork = (fit == forkStamps.end()) ? 0 : stats::instructions - fit->second;
+
+  //forks per instruction of the current function (call path)
+  double forkRate = 0;
+  CallPathNode *cpn = es.stack.empty() ? 0 : es.stack.back().callPathNode;
+  if(cpn) {
+    uint64_t insts = cpn->statistics.getValue(stats::instructions);
+    if(insts) forkRate = (double) cpn->statistics.getValue(stats::forks) / insts;
+  }
+
+  //symbolic branches per execution of the instruction the state waits at
+  double density = 0;
+  if(statsTracker) {
+    StatisticManager &sm = *theStatisticManager;
+    unsigned id = es.pc->info->id;
+    uint64_t insts = sm.getIndexedValue(stats::instructions, id);
+    if(insts) density = (double) sm.getIndexedValue(stats::forks, id) / insts;
   }
+
+  unsigned recoveries = es.getSnapshots().size();
+  return levels * (instsSinceFork + 1) * (1 + SUBTREE_FORK_RATE_WEIGHT * forkRate + density) *
+    (1 + recoveries);
+}
+
+bool Executor::addState2WorkList(ExecutionState &state, int count) {
+
+  //worklist entries go out as plain prefix packets (no suffixes)
+  PrefixPacket packet;
+  packet.common = PackedBranchHist(state.branchHist.begin(), state.branchHist.end());
+  std::vector<char> bytes;
+  packet.encode(bytes);
+
+  char* newPath = (char*)malloc(bytes.size()*sizeof(char));
+  memcpy(newPath, &bytes[0], bytes.size());
   workList[count] = newPath;
-  workListPathSize.push_back(state.branchHist.size());
+  workListPathSize.push_back(bytes.size());
   return true;
 }
 
@@ -4084,12 +4603,10 @@ void Executor::terminateStateOnExit(ExecutionState &state) {
     //if(ENABLE_LOGGING) //printStatePath(state, brhistFile, "");
     //if(ENABLE_LOGGING) //brhistFile.flush();
     
-    if(ENABLE_LOGGING) {
-      for(int x=0; x<(state.branchHist).size(); x++) {
-        brhistFile<<state.branchHist[x];
-      }
-      brhistFile<<"\n";
-      brhistFile.flush();
+    deepestExitDepth = std::max(deepestExitDepth, (unsigned) state.branchHist.size());
+    //written whenever setBrHistFile was called, see klee-dump-brhist
+    if(brhistWriter) {
+      brhistWriter->append(PackedBranchHist(state.branchHist.begin(), state.branchHist.end()));
     }
     
     terminateState(state);
@@ -4776,7 +5293,10 @@ char** Executor::runFunctionAsMain2(Function *f,
          char **envp,
          //char** workList_main,
          std::vector<unsigned int> &workListPathSize_main) {
-  if(explorationDepth > 0) {
+  //workers given -phase2Depth take their tasks like the others and stop
+  //at the depth, only the master expands phase 1 into the worklist
+  bool branchLevelHalt = explorationDepth > 0;
+  if(branchLevelHalt && coreId == MASTER_NODE) {
     runFunctionAsMain(f, argc, argv, envp, true);
     states.clear();
     workListPathSize_main = workListPathSize;
@@ -4784,7 +5304,41 @@ char** Executor::runFunctionAsMain2(Function *f,
     return workList;
   }
   else {
-    runFunctionAsMain(f, argc, argv, envp);
+    //prefix tasks arrive from the master in the packed wire form
+    if(enablePathPrefixFilter && !upperBound) {
+      //a spare rank without a prefix starts out by stealing
+      assert(P2PSteal && "prefix task without a prefix");
+      stealWork();
+    } else if(enablePathPrefixFilter) {
+      PrefixPacket packet;
+      //a malformed task is finished without running, see acceptPrefixPacket
+      if(packet.decode(upperBound, prefixDepth))
+        adoptPrefix(packet);
+      else
+        klee_warning("process %d: dropping a malformed prefix task of %u bytes",
+                     coreId, prefixDepth);
+      ++tasksAcquired;
+      if(theEventTrace) theEventTrace->record(EventTrace::TaskStart, 0, 1);
+    } else {
+      ++tasksAcquired;
+      if(theEventTrace) theEventTrace->record(EventTrace::TaskStart, 0, 1);
+      runFunctionAsMain(f, argc, argv, envp, branchLevelHalt);
+    }
+    //fresh prefixes received after FINISH reuse the resident module
+    while(!pendingPrefixes.empty()) {
+      std::vector<unsigned char> &path = pendingPrefixes.front();
+      char* prefix = (char*)malloc(path.size()*sizeof(char));
+      memcpy(prefix, &path[0], path.size());
+      setUpperBound(prefix);
+      setLowerBound(prefix);
+      enablePrefixChecking();
+      setTestPrefixDepth(path.size());
+      pendingPrefixes.pop_front();
+      runFunctionAsMain(f, argc, argv, envp, branchLevelHalt);
+      free(prefix);
+      setUpperBound(NULL);
+      setLowerBound(NULL);
+    }
   }
 
   if (statsTracker)
@@ -4903,6 +5457,8 @@ void Executor::runFunctionAsMain(Function *f,
   processTree = new PTree(state);
   state->ptreeNode = processTree->root;
 	run(*state, branchLevelHalt, enablePathPrefixFilter);
+  //suspended states point into the memory manager that is dropped below
+  releaseSuspendedPrefixStates();
   delete processTree;
   processTree = 0;
   
@@ -4913,6 +5469,7 @@ void Executor::runFunctionAsMain(Function *f,
  
   if(pathWriter) { 
     delete pathWriter;
+    pathWriter = 0;
   }
   
   globalObjects.clear();
@@ -5251,7 +5808,13 @@ bool Executor::getAllRecoveryInfo(ExecutionState &state, KInstruction *ki,
     );
 
     ref<Expr> expr;
-    if (state.getRecoveredValue(index, sliceId, loadAddr, expr)) {
+    bool recovered = state.getRecoveredValue(index, sliceId, loadAddr, expr);
+    if (!recovered && lookupRecoveryMemo(state, recoveryInfo, expr)) {
+      /* another lineage ran this slice from the same snapshot */
+      state.updateRecoveredValue(index, sliceId, loadAddr, expr);
+      recovered = true;
+    }
+    if (recovered) {
       /* this slice was already executed from this snapshot,
          and we know which value was written (or not) */
       state.addRecoveredAddress(loadAddr);
@@ -5427,6 +5990,9 @@ void Executor::resumeState(ExecutionState &state, bool implicitlyCreated, Execut
 
   /* debug... */
   state.getAllocationRecord().dump();
+
+  if (AdaptiveRecoverySplit)
+    recoveryProfile.onDependentResumed(getSliceKey(recState.getRecoveryInfo()));
    
   replicateBranchHist(&recState, &state);
   if(ENABLE_LOGGING) {
@@ -5443,6 +6009,11 @@ void Executor::onRecoveryStateExit(ExecutionState &state) {
     mylogFile.flush();
   }
   DEBUG_WITH_TYPE(DEBUG_BASIC, klee_message("%p: recovery state reached exit instruction", &state));
+  if (theEventTrace)
+    theEventTrace->record(EventTrace::RecoveryFinish, state.getRecoveryInfo()->sliceId);
+  if (RecoveryMemoization) {
+    memoizeRecovery(state);
+  }
   ExecutionState *dependentState = state.getDependentState();
   //dumpConstrains(*dependentState);
 
@@ -5458,6 +6029,65 @@ void Executor::onRecoveryStateExit(ExecutionState &state) {
   terminateState(state);
 }
 
+/* only recoveries from the first snapshot are memoized, the later ones
+ * depend on the recovery cache of their own lineage */
+void Executor::memoizeRecovery(ExecutionState &recoveryState) {
+  ref<RecoveryInfo> recoveryInfo = recoveryState.getRecoveryInfo();
+  if (recoveryInfo->snapshotIndex != 0) {
+    return;
+  }
+  std::set<ExecutionState*>::iterator it = unmemoizableRecoveries.find(&recoveryState);
+  if (it != unmemoizableRecoveries.end()) {
+    unmemoizableRecoveries.erase(it);
+    return;
+  }
+
+  ref<Expr> value;
+  ExecutionState *dependentState = recoveryState.getDependentState();
+  if (!dependentState->getRecoveredValue(recoveryInfo->snapshotIndex,
+                                         recoveryInfo->sliceId,
+                                         recoveryInfo->loadAddr, value)) {
+    return;
+  }
+  recoveryMemo.insert(*recoveryInfo, recoveryState.constraints, value);
+}
+
+bool Executor::lookupRecoveryMemo(ExecutionState &state, ref<RecoveryInfo> recoveryInfo,
+                                  ref<Expr> &value) {
+  if (!RecoveryMemoization || recoveryInfo->snapshotIndex != 0) {
+    return false;
+  }
+  const std::vector<RecoveryMemo::Result> *results = recoveryMemo.find(*recoveryInfo);
+  if (!results) {
+    return false;
+  }
+
+  /* the recovery would follow the same path, whatever its guiding constraints */
+  for (std::vector<RecoveryMemo::Result>::const_iterator i = results->begin();
+       i != results->end(); i++) {
+    ref<Expr> path = ConstantExpr::alloc(1, Expr::Bool);
+    for (std::vector< ref<Expr> >::const_iterator j = i->conditions.begin();
+         j != i->conditions.end(); j++) {
+      path = AndExpr::create(path, *j);
+    }
+    bool implied;
+    solver->setTimeout(coreSolverTimeout);
+    bool success = solver->mustBeTrue(state, path, implied);
+    solver->setTimeout(0);
+    if (success && implied) {
+      DEBUG_WITH_TYPE(
+        DEBUG_BASIC,
+        klee_message("%p: memoized recovery (slice id = %u, addr = %lx)",
+                     &state, recoveryInfo->sliceId, recoveryInfo->loadAddr)
+      );
+      value = i->value;
+      ++stats::recoveryMemoHits;
+      return true;
+    }
+  }
+  return false;
+}
+
 void Executor::notifyDependentState(ExecutionState &recoveryState) {
   ExecutionState *dependentState = recoveryState.getDependentState();
   DEBUG_WITH_TYPE(DEBUG_BASIC, klee_message("%p: notifying dependent state %p", &recoveryState, dependentState));
@@ -5489,6 +6119,8 @@ void Executor::startRecoveryState(ExecutionState &state, ref<RecoveryInfo> recov
   );
 
   ref<ExecutionState> snapshotState = recoveryInfo->snapshot->state;
+  if (theEventTrace)
+    theEventTrace->record(EventTrace::RecoveryStart, recoveryInfo->sliceId);
 
   /* TODO: non-first snapshots hold normal state properties! */
 
@@ -5581,6 +6213,15 @@ void Executor::startRecoveryState(ExecutionState &state, ref<RecoveryInfo> recov
 
   /* add the recovery state to the searcher */
   recoveryState->setPriority(PRIORITY_HIGH);
+  if (AdaptiveRecoverySplit) {
+    RecoveryProfile::SliceKey key = getSliceKey(recoveryInfo);
+    /* root recoveries of slices that unblock less per instruction than the
+     * average wait their turn, nested ones still run first */
+    if (!state.isRecoveryState() &&
+        recoveryProfile.getYield(key) < recoveryProfile.getAverageYield())
+      recoveryState->setPriority(PRIORITY_LOW);
+    recoveryProfile.onRecoveryStarted(key);
+  }
   addedStates.push_back(recoveryState);
 
   /* update statistics */
@@ -5751,6 +6392,9 @@ MemoryObject *Executor::onExecuteAlloc(ExecutionState &state, uint64_t size, boo
 
     ExecutionState *dependentState = state.getDependentState();
     AllocationRecord &guidingAllocationRecord = state.getGuidingAllocationRecord();
+    if (RecoveryMemoization) {
+        unmemoizableRecoveries.insert(&state);
+    }
     AllocationRecord &allocationRecord = dependentState->getAllocationRecord();
 
     if (guidingAllocationRecord.exists(context)) {
@@ -5823,6 +6467,9 @@ bool Executor::isDynamicAlloc(Instruction *allocInst) {
 
 void Executor::onExecuteFree(ExecutionState *state, const MemoryObject *mo) {
     ExecutionState *dependentState = state->getDependentState();
+    if (RecoveryMemoization) {
+        unmemoizableRecoveries.insert(state);
+    }
     unbindAll(dependentState, mo);
 }
 
@@ -5917,6 +6564,9 @@ void Executor::unbindAll(ExecutionState *state, const MemoryObject *mo) {
 }
 
 void Executor::forkDependentStates(ExecutionState *trueState, ExecutionState *falseState) {
+    if (unmemoizableRecoveries.count(trueState)) {
+        unmemoizableRecoveries.insert(falseState);
+    }
     ExecutionState *current = trueState->getDependentState();
     ExecutionState *forked = NULL;
     ExecutionState *prevForked = falseState;
@@ -6051,49 +6701,23 @@ ExecutionState *Executor::createSnapshotState(ExecutionState &state) {
     /* remove guiding constraints */
     snapshotState->clearGuidingConstraints();
 
-    return snapshotState;
-}
-
-bool Executor::checkRange(std::vector<unsigned char> inPath) {
-  bool violatePrefix = false;
-  if(ENABLE_LOGGING) {
-    mylogFile << "Checking feasibility of Path: ";
-    for (auto I = inPath.begin(); I != inPath.end(); ++I) {
-      mylogFile << *I;
-    }
-    mylogFile << "\n";
-    mylogFile.flush();
-  } 
-
-  int minLen = (inPath.size()<prefixDepth)?inPath.size():prefixDepth;
-  if (convertPath2Number(inPath, minLen) != convertPath2Number(upperBound, minLen)) {
-    violatePrefix = true;
-  }
-  return violatePrefix;
-}
-
-int Executor::convertPath2Number(std::vector<unsigned char> inPath, int upto) {
-  int limit = (upto==0)?(inPath.size()-1):(upto-1);
-  int sum = 0, index=0;
-  for(int it=limit; it >= 0; it--) {
-    if(inPath[it]=='1') {
-      sum = sum+pow(2,index);
+    /* the branch history and the prefixes are taken from the dependent state
+     * when a recovery starts (replicateBranchHist), the snapshot does not
+     * need its own copy */
+    decltype(snapshotState->branchHist)().swap(snapshotState->branchHist);
+    snapshotState->depth = 0;
+    snapshotState->clearPrefixes();
+
+    /* the address space is shared copy on write, only the rest is ours */
+    uint64_t bytes = sizeof(ExecutionState) +
+                     snapshotState->constraints.size() * sizeof(ref<Expr>);
+    for (std::vector<StackFrame>::iterator it = snapshotState->stack.begin(),
+           ie = snapshotState->stack.end(); it != ie; ++it) {
+        bytes += sizeof(StackFrame) + it->kf->numRegisters * sizeof(Cell);
     }
-    index++;
-  }
-  return sum;
-}
+    stats::snapshotBytesTotal += bytes;
 
-int Executor::convertPath2Number(char* inPath, int upto) {
-  int limit = (upto==0)?(prefixDepth-1):(upto-1);
-  int sum = 0, index=0;
-  for(int it=limit; it >= 0; it--) {
-    if(inPath[it]=='1') {
-      sum = sum+pow(2,index);
-    }
-    index++;
-  }
-  return sum;
+    return snapshotState;
 }
 
 //adding a utility to print paths
@@ -6124,6 +6748,272 @@ void Executor::replicateBranchHist(ExecutionState* state, ExecutionState* recSta
   recState->prefixes = state->prefixes;
 }
 
+void Executor::adoptPrefix(const PrefixPacket &packet) {
+  std::vector<unsigned char> path;
+  if(packet.suffixes.empty()) {
+    packet.getPath(-1, path);
+    pendingPrefixes.push_back(path);
+  }
+  for(int x=0; x<packet.suffixes.size(); x++) {
+    packet.getPath(x, path);
+    pendingPrefixes.push_back(path);
+  }
+}
+
+unsigned Executor::countPendingSuspended() {
+  unsigned searched = searcher->getSize();
+  return states.size() > searched ? states.size() - searched : 0;
+}
+
+int Executor::pickStealVictim(int numRanks) {
+  //go back to the last victim that had work, it likely still has some
+  if(lastVictim >= 2 && lastVictim != coreId) {
+    int victim = lastVictim;
+    lastVictim = -1;
+    return victim;
+  }
+  const std::vector<int> &local = theNodeTopology->getLocalWorkers();
+  const std::vector<int> &remote = theNodeTopology->getRemoteWorkers();
+  if(LocalStealAttempts && !(local.empty() && remote.empty())) {
+    //states stolen on the node come through shared memory
+    if(!local.empty() && (localStealTries < LocalStealAttempts || remote.empty())) {
+      ++localStealTries;
+      return local[theRNG.getInt32() % local.size()];
+    }
+    localStealTries = 0;
+    return remote[theRNG.getInt32() % remote.size()];
+  }
+  int victim;
+  do {
+    victim = 2 + theRNG.getInt32() % (numRanks-2);
+  } while(victim == coreId);
+  return victim;
+}
+
+void Executor::recvStealAck() {
+  char ack;
+  MPI_Status status;
+  MPI_Recv(&ack, 1, MPI_CHAR, MASTER_NODE, STEAL_ACK, MPI_COMM_WORLD, &status);
+  assert(pendingStealAcks && "STEAL_ACK without a steal");
+  --pendingStealAcks;
+}
+
+void Executor::stealWork() {
+  int numRanks;
+  MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+  unsigned backoff = STEAL_MIN_BACKOFF;
+  EventTraceSpan idle(EventTrace::Idle);
+
+  while(!haltFromMaster) {
+    int flag;
+    MPI_Status status;
+
+    //the master may still hand out worklist prefixes, or shut us down
+    MPI_Iprobe(MASTER_NODE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+    if(flag && status.MPI_TAG == STEAL_ACK) {
+      //the master answers in order, a KILL may be queued behind it
+      recvStealAck();
+      continue;
+    } else if(flag && status.MPI_TAG == KILL) {
+      //left pending for the worker driver
+      haltFromMaster = true;
+      haltExecution = true;
+      return;
+    } else if(flag && status.MPI_TAG == START_PREFIX_TASK) {
+      int count;
+      MPI_Get_count(&status, MPI_CHAR, &count);
+      char* recv_prefix = (char*)malloc(count*sizeof(char));
+      MPI_Recv(recv_prefix, count, MPI_CHAR, MASTER_NODE, START_PREFIX_TASK, MPI_COMM_WORLD, &status);
+      acceptPrefixPacket(recv_prefix, count);
+      free(recv_prefix);
+      return;
+    }
+
+    //no peers to steal from
+    if(numRanks <= 3) {
+      usleep(STEAL_MAX_BACKOFF);
+      continue;
+    }
+
+    int victim = pickStealVictim(numRanks);
+    char dummy;
+    MPI_Send(&dummy, 1, MPI_CHAR, victim, STEAL_REQ, MPI_COMM_WORLD);
+
+    //wait for the victim, refusing the peers that try to steal from us
+    bool answered = false;
+    while(!answered) {
+      MPI_Iprobe(victim, STEAL_RESP, MPI_COMM_WORLD, &flag, &status);
+      if(flag) {
+        answered = true;
+        break;
+      }
+      MPI_Iprobe(MPI_ANY_SOURCE, STEAL_REQ, MPI_COMM_WORLD, &flag, &status);
+      if(flag) {
+        char stealFailed = 'x';
+        MPI_Recv(&dummy, 1, MPI_CHAR, status.MPI_SOURCE, STEAL_REQ, MPI_COMM_WORLD, &status);
+        MPI_Send(&stealFailed, 1, MPI_CHAR, status.MPI_SOURCE, STEAL_RESP, MPI_COMM_WORLD);
+        continue;
+      }
+      MPI_Iprobe(MASTER_NODE, KILL, MPI_COMM_WORLD, &flag, &status);
+      if(flag) {
+        haltFromMaster = true;
+        haltExecution = true;
+        return;
+      }
+      usleep(STEAL_POLL_INTERVAL);
+    }
+
+    int count;
+    MPI_Get_count(&status, MPI_CHAR, &count);
+    char* recv_prefix = (char*)malloc(count*sizeof(char));
+    MPI_Recv(recv_prefix, count, MPI_CHAR, victim, STEAL_RESP, MPI_COMM_WORLD, &status);
+    if(count > 1) {
+      if(ENABLE_OFFLOAD_LOGGING) {
+        mylogFile << "Stole from: "<<victim<<" Packet Size: "<<count<<"\n";
+        mylogFile.flush();
+      }
+      acceptPrefixPacket(recv_prefix, count);
+      free(recv_prefix);
+      ++pendingStealAcks;
+      lastVictim = victim;
+      localStealTries = 0;
+      return;
+    }
+    free(recv_prefix);
+
+    usleep(backoff);
+    backoff = std::min(backoff*2, (unsigned) STEAL_MAX_BACKOFF);
+  }
+}
+
+void Executor::releaseSuspendedPrefixStates() {
+  for(auto it = prefixSuspendedStatesMap.begin(); it != prefixSuspendedStatesMap.end(); ++it) {
+    delete it->second;
+  }
+  prefixSuspendedStatesMap.clear();
+  suspendedStateSize.clear();
+  suspendedStateOrder.clear();
+  suspendedStateBytes = 0;
+  forkStamps.clear();
+  delete prefixTree;
+  prefixTree = new PrefixTree();
+}
+
+uint64_t Executor::estimateStateBytes(ExecutionState *es) {
+  //an upper bound, object states are shared copy on write between states
+  uint64_t bytes = sizeof(ExecutionState) + es->constraints.size() * sizeof(ref<Expr>);
+  for (MemoryMap::iterator it = es->addressSpace.objects.begin(),
+         ie = es->addressSpace.objects.end(); it != ie; ++it) {
+    bytes += it->first->size;
+  }
+  return bytes;
+}
+
+//drops the oldest suspended states past the budget, a later task on their
+//path resumes from the deepest ancestor still suspended, or from main
+void Executor::enforceSuspendedStateBudget() {
+  if(suspendedStateBytes > stats::suspendedStateBytesPeak) {
+    stats::suspendedStateBytesPeak += suspendedStateBytes - stats::suspendedStateBytesPeak;
+  }
+  if(!SuspendedStateBudget) return;
+
+  uint64_t budget = (uint64_t) SuspendedStateBudget << 20;
+  while(suspendedStateBytes > budget && !suspendedStateOrder.empty()) {
+    std::string path = suspendedStateOrder.front();
+    suspendedStateOrder.pop_front();
+    auto bit = suspendedStateSize.find(path);
+    if(bit == suspendedStateSize.end()) continue; //resumed meanwhile
+    auto sit = prefixSuspendedStatesMap.find(path);
+    assert(sit != prefixSuspendedStatesMap.end());
+    ExecutionState *es = sit->second;
+    //recovery states are tied to their dependent state, keep them
+    if(!es->isNormalState()) continue;
+
+    suspendedStateBytes -= bit->second;
+    suspendedStateSize.erase(bit);
+    prefixSuspendedStatesMap.erase(sit);
+    seedMap.erase(es);
+    forkStamps.erase(es);
+    processTree->remove(es->ptreeNode);
+    delete es;
+    ++stats::evictedSuspendedStates;
+  }
+  if(ENABLE_OFFLOAD_LOGGING) {
+    mylogFile << "Suspended States: "<<prefixSuspendedStatesMap.size()<<" Bytes: "
+      <<suspendedStateBytes<<" Evicted: "<<stats::evictedSuspendedStates<<"\n";
+  }
+}
+
+//a bounded state becomes a plain prefix task, the batch goes out as one
+//NEW_TASK carrying its length and the u32-length-prefixed packets under
+//OFFLOAD_PKT
+void Executor::queueBoundedTask(ExecutionState &state) {
+  appendPrefixTask(boundedTasks, state.branchHist.begin(), state.branchHist.end());
+  ++stats::splitTasks;
+  if(++numBoundedTasks >= SPLIT_TASK_BATCH)
+    flushBoundedTasks();
+}
+
+void Executor::flushBoundedTasks() {
+  if(!numBoundedTasks) return;
+  uint32_t len = boundedTasks.size();
+  MPI_Send(&len, sizeof(len), MPI_CHAR, coordinator, NEW_TASK, MPI_COMM_WORLD);
+  MPI_Send(&boundedTasks[0], len, MPI_CHAR, coordinator, OFFLOAD_PKT, MPI_COMM_WORLD);
+  if(ENABLE_OFFLOAD_LOGGING) {
+    mylogFile << "Bounded Tasks: "<<numBoundedTasks<<" Bytes: "<<len<<"\n";
+    mylogFile.flush();
+  }
+  boundedTasks.clear();
+  numBoundedTasks = 0;
+}
+
+//the frontier is every live state and queued path as a plain prefix task.
+//A state still replaying its prefix is saved by what it replayed so far,
+//a restart may explore more than the state had left but never less
+void Executor::sendCheckpoint() {
+  char dummy;
+  MPI_Status status;
+  MPI_Recv(&dummy, 1, MPI_CHAR, MASTER_NODE, CHECKPOINT, MPI_COMM_WORLD, &status);
+  //the master has the bounded states before the frontier that leaves them out
+  flushBoundedTasks();
+
+  std::vector<char> batch;
+  unsigned numTasks = 0;
+  for(auto it=states.begin(); it!=states.end(); ++it) {
+    //recovery states are rebuilt from the states they serve
+    if((*it)->isRecoveryState()) continue;
+    appendPrefixTask(batch, (*it)->branchHist.begin(), (*it)->branchHist.end());
+    ++numTasks;
+  }
+  for(auto it=pendingPrefixes.begin(); it!=pendingPrefixes.end(); ++it) {
+    appendPrefixTask(batch, it->begin(), it->end());
+    ++numTasks;
+  }
+
+  uint32_t len = batch.size();
+  MPI_Send(&len, sizeof(len), MPI_CHAR, MASTER_NODE, CHECKPOINT_RESP, MPI_COMM_WORLD);
+  if(len)
+    MPI_Send(&batch[0], len, MPI_CHAR, MASTER_NODE, OFFLOAD_PKT, MPI_COMM_WORLD);
+  if(ENABLE_LOGGING) {
+    mylogFile << "Checkpoint Tasks: "<<numTasks<<" Bytes: "<<len<<"\n";
+    mylogFile.flush();
+  }
+}
+
+//the same fallback as enforceSuspendedStateBudget: nothing is written
+//out, the state is rebuilt by a full prefix replay from main when
+//runFunctionAsMain2 drains pendingPrefixes
+void Executor::evictStateToReplay(ExecutionState &state) {
+  pendingPrefixes.push_back(std::vector<unsigned char>(state.branchHist.begin(),
+                                                       state.branchHist.end()));
+  ++stats::memoryEvictedStates;
+  if(ENABLE_LOGGING) {
+    mylogFile << "Evicted State: "<<&state<<" Depth: "<<state.branchHist.size()<<"\n";
+    mylogFile.flush();
+  }
+  terminateState(state);
+}
+
 void Executor::printBranchHist(ExecutionState* state) {
   mylogFile<<"Branch History: ";
   for(int x=0; x<(state->branchHist).size(); x++) {
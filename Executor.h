@@ -17,12 +17,18 @@
 
 #include "klee/ExecutionState.h"
 #include "klee/Interpreter.h"
+#include "klee/Solver.h"
 #include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/KModule.h"
 #include "klee/util/ArrayCache.h"
 #include "llvm/Support/raw_ostream.h"
 #include "PrefixTree.h"
+#include "BranchHistory.h"
+#include "OffloadPolicy.h"
+#include "RecoveryProfile.h"
+#include "RecoveryMemo.h"
+#include "ExprTable.h"
 
 #include "llvm/ADT/Twine.h"
 
@@ -35,6 +41,7 @@
 #include "klee/Internal/Analysis/Annotator.h"
 
 #include <vector>
+#include <deque>
 #include <string>
 #include <map>
 #include <set>
@@ -161,7 +168,7 @@ private:
   /// Suspended because of prefix ranging  
   std::vector<ExecutionState *> rangingSuspendedStates;
   
-  /// map from the prefix to the suspended states
+  /// map from the packed prefix (PackedBranchHist::key) to the suspended states
   std::map<std::string, ExecutionState*> prefixSuspendedStatesMap;
 
   /// When non-empty the Executor is running in "seed" mode. The
@@ -201,6 +208,16 @@ private:
   /// needed to control memory usage. \see fork()
   bool atMemoryLimit;
 
+  /// Set by the memory timer, the next instruction step samples the
+  /// memory usage. \see checkMemoryUsage()
+  bool memoryCheckDue;
+
+  /// Set by the timer of -share-coverage. \see shareCoverage()
+  bool coverageShareDue;
+  /// -lean-replay: the instruction just run replayed a prefix and no
+  /// poll is due, updateStates leaves the messages for later
+  bool deferPolls;
+
   /// Disables forking, set by client. \see setInhibitForking()
   bool inhibitForking;
 
@@ -271,9 +288,15 @@ private:
   unsigned int branchLevel2Halt;
   bool enableLB;
   bool ready2Offload;
+  /// what the coordinator was last told, and when
+  bool readyReported;
+  double lastReadyReport;
 
   ///MPI_WorkerID
   int coreId;
+  /// the rank handing out this worker's tasks, the master or the
+  /// coordinator of its group
+  int coordinator;
   
   /// search mode
   std::string searchMode;
@@ -286,7 +309,8 @@ private:
 
   // branch history
   std::string brhistFileName;
-  std::ofstream brhistFile;
+  /// histories of the states that reached exit, read with BranchHistReader
+  BranchHistWriter *brhistWriter;
 
   //flag to prevent
   bool coreInitialized; 
@@ -295,6 +319,56 @@ private:
   char* upperBound;
   char* lowerBound;
 
+  /// paths received that have no suspended state to resume from, they
+  /// are replayed from main on the resident module
+  std::deque<std::vector<unsigned char> > pendingPrefixes;
+  /// -split-bounded-states tasks not sent to the master yet
+  std::vector<char> boundedTasks;
+  unsigned numBoundedTasks;
+
+  /// tasks taken (from the master or stolen) since the last FINISH
+  unsigned tasksAcquired;
+  /// tasks stolen whose grant the master has not acknowledged yet, no
+  /// FINISH goes out before they are
+  unsigned pendingStealAcks;
+
+  /// rank we last stole from successfully, -1 if none
+  int lastVictim;
+
+  /// steals tried on this node since the last success or remote try
+  unsigned localStealTries;
+
+  /// picks the states given away on an offload request (-offloadPolicy)
+  OffloadPolicy *offloadPolicy;
+
+  /// idle ranks and donors asked, as told by the last offload request
+  unsigned offloadIdleHint, offloadDonorHint;
+  /// longest branch history of the paths that reached their exit, what
+  /// the offload policy expects a subtree to reach without -phase2Depth
+  unsigned deepestExitDepth;
+
+  /// recovery cost and yield per slice, for -adaptive-recovery-split
+  RecoveryProfile recoveryProfile;
+
+  /// completed recoveries reusable by other lineages, for -recovery-memo
+  RecoveryMemo recoveryMemo;
+
+  /// one node per constraint structure, for -intern-constraints
+  ExprTable exprTable;
+
+  /// recovery states whose result can not be reused, they allocated or
+  /// freed memory in their dependent states
+  std::set<ExecutionState*> unmemoizableRecoveries;
+
+  /// instruction count when each live state was forked, for the cost model
+  std::map<const ExecutionState*, uint64_t> forkStamps;
+
+  /// estimated bytes of the states in prefixSuspendedStatesMap, oldest
+  /// first, bounded by -suspended-state-budget
+  uint64_t suspendedStateBytes;
+  std::map<std::string, uint64_t> suspendedStateSize;
+  std::deque<std::string> suspendedStateOrder;
+
   //logFile
   std::string logFileName;
   std::ofstream mylogFile;
@@ -527,6 +601,9 @@ private:
   void processTimers(ExecutionState *current,
                      double maxInstTime);
   void checkMemoryUsage();
+  /// Merges the coverage of the other ranks into the indexed coverage
+  /// statistics and reweights the searcher.
+  void shareCoverage();
   void printDebugInstructions(ExecutionState &state);
   void doDumpStates();
 
@@ -544,6 +621,12 @@ private:
   void notifyDependentState(ExecutionState &recoveryState);
   void onRecoveryStateExit(ExecutionState &state);
   void startRecoveryState(ExecutionState &state, ref<RecoveryInfo> recoveryInfo);
+
+  /// Looks for a completed recovery of \param recoveryInfo whose path
+  /// conditions \param state implies, \param value is what it wrote.
+  bool lookupRecoveryMemo(ExecutionState &state, ref<RecoveryInfo> recoveryInfo,
+                          ref<Expr> &value);
+  void memoizeRecovery(ExecutionState &recoveryState);
   void onRecoveryStateWrite(
     ExecutionState &state,
     ref<Expr> address,
@@ -579,13 +662,12 @@ private:
   ExecutionState *createSnapshotState(ExecutionState &state);
 
   //PSE Functions
-  bool checkRange(std::vector<unsigned char> inPath);
-  int convertPath2Number(std::vector<unsigned char> inPath, int upto=0);
-  int convertPath2Number(char* inPath, int upto=0);
   void printPath(char* path, std::ostream& log, std::string message);
   void printStatePath(ExecutionState& state, std::ostream& log, std::string message);
   void replicateBranchHist(ExecutionState* state, ExecutionState* recState);
   bool addState2WorkList(ExecutionState &state,int count);
+  bool streamFrontierState(ExecutionState &current);
+  double estimateSubtreeCost(ExecutionState &es, unsigned maxDepth);
   ExecutionState* offLoad(bool &valid);
   ExecutionState* offloadFromStatesVector(bool &valid);
   int offloadFromStatesVector(std::vector<ExecutionState*>& offloadVec);
@@ -593,6 +675,27 @@ private:
   void check2Offload();
   void newCheck2Offload();
   void printBranchHist(ExecutionState* state);
+  void adoptPrefix(const PrefixPacket &packet);
+  void acceptPrefixPacket(const char* buf, unsigned size);
+  bool buildOffloadPacket(std::vector<char> &pkt2Send);
+  void recvOffloadRequest();
+  void sendOffloadPacket(const std::vector<char> &pkt2Send);
+  int pickStealVictim(int numRanks);
+  /// states waiting for a recovery, they are not in the searcher
+  unsigned countPendingSuspended();
+  void stealWork();
+  void recvStealAck();
+  void releaseSuspendedPrefixStates();
+  bool evaluateBranch(ExecutionState &state, ref<Expr> condition,
+                      Solver::Validity &res, double timeout);
+  uint64_t estimateStateBytes(ExecutionState *es);
+  void enforceSuspendedStateBudget();
+  /// Drop \param state and queue its path for a later replay from main.
+  void evictStateToReplay(ExecutionState &state);
+  void queueBoundedTask(ExecutionState &state);
+  void flushBoundedTasks();
+  /// Answers a CHECKPOINT of the master with the frontier of this worker.
+  void sendCheckpoint();
 
 public:
   Executor(InterpreterOptions &opts, InterpreterHandler *ie);
@@ -637,7 +740,8 @@ public:
 
   virtual void setBrHistFile(std::string inBrHistFile) {
   	brhistFileName = inBrHistFile;
-   	brhistFile.open(brhistFileName);
+    delete brhistWriter;
+    brhistWriter = new BranchHistWriter(brhistFileName);
   }
 
   virtual void enableLoadBalancing(bool inLB) {
@@ -0,0 +1,80 @@
+//===-- ExprTable.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ExprTable.h"
+
+#include "klee/Statistic.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+//nodes held before the first sweep, later the table may double between two
+#define EXPR_TABLE_MIN_SWEEP (1 << 16)
+
+//no expression kind has more kids than a select
+#define EXPR_MAX_KIDS 3
+
+namespace klee {
+  namespace stats {
+    //see -intern-constraints, the hits over the lookups is the
+    //deduplication ratio
+    Statistic exprInternLookups("ExprInternLookups", "EILookups");
+    Statistic exprInternHits("ExprInternHits", "EIHits");
+  }
+}
+
+ExprTable::ExprTable() : sweepAt(EXPR_TABLE_MIN_SWEEP) {}
+
+void ExprTable::sweep() {
+  for (std::unordered_set<ref<Expr>, Hash>::iterator it = nodes.begin();
+       it != nodes.end();) {
+    //a parent dropped here frees its kids for the next sweep
+    if ((*it)->refCount == 1)
+      it = nodes.erase(it);
+    else
+      ++it;
+  }
+  sweepAt = std::max((size_t) EXPR_TABLE_MIN_SWEEP, 2 * nodes.size());
+}
+
+ref<Expr> ExprTable::intern(const ref<Expr> &e) {
+  //constants are small and not worth a slot
+  if (isa<ConstantExpr>(e))
+    return e;
+
+  ++stats::exprInternLookups;
+  std::unordered_set<ref<Expr>, Hash>::iterator it = nodes.find(e);
+  if (it != nodes.end()) {
+    if (it->get() != e.get())
+      ++stats::exprInternHits;
+    return *it;
+  }
+
+  unsigned numKids = e->getNumKids();
+  assert(numKids <= EXPR_MAX_KIDS && "unexpected number of kids");
+  ref<Expr> kids[EXPR_MAX_KIDS];
+  bool shared = false;
+  for (unsigned i = 0; i < numKids; ++i) {
+    kids[i] = intern(e->getKid(i));
+    shared |= kids[i].get() != e->getKid(i).get();
+  }
+  ref<Expr> node = e;
+  if (shared) {
+    //the rebuild may simplify again, only a node of the same shape will do
+    ref<Expr> rebuilt = e->rebuild(kids);
+    if (rebuilt == e)
+      node = rebuilt;
+  }
+
+  if (nodes.size() >= sweepAt)
+    sweep();
+  nodes.insert(node);
+  return node;
+}
@@ -0,0 +1,50 @@
+//===-- ExprTable.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Hash-consing of the constraints added to states. Sibling states build
+// the same branch conditions from their own copies of memory, the table
+// hands them one node for each structure so the trees are shared, down to
+// the reads, whose arrays the ArrayCache already keeps unique.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRTABLE_H
+#define KLEE_EXPRTABLE_H
+
+#include "klee/Expr.h"
+
+#include <unordered_set>
+
+namespace klee {
+
+class ExprTable {
+  struct Hash {
+    size_t operator()(const ref<Expr> &e) const { return e->hash(); }
+  };
+
+  /// ref<Expr>::operator== compares the structure
+  std::unordered_set<ref<Expr>, Hash> nodes;
+  size_t sweepAt;
+
+  /// Drops the nodes only the table still holds.
+  void sweep();
+
+public:
+  ExprTable();
+
+  /// The node of the table with the structure of \param e, the subtrees
+  /// of a new one are shared with the table first.
+  ref<Expr> intern(const ref<Expr> &e);
+
+  size_t size() const { return nodes.size(); }
+};
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+//===-- NodeTopology.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "NodeTopology.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace klee;
+
+namespace klee {
+  NodeTopology *theNodeTopology = 0;
+}
+
+NodeTopology::NodeTopology(unsigned groupSize)
+  : nodeComm(MPI_COMM_NULL), nodeId(0), numNodes(1), coordinator(0) {
+  int rank, numRanks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                      MPI_INFO_NULL, &nodeComm);
+
+  //a node is named after its lowest world rank
+  int leader;
+  MPI_Allreduce(&rank, &leader, 1, MPI_INT, MPI_MIN, nodeComm);
+  std::vector<int> leaders(numRanks);
+  MPI_Allgather(&leader, 1, MPI_INT, &leaders[0], 1, MPI_INT, MPI_COMM_WORLD);
+
+  for (int r = 2; r < numRanks; ++r) {
+    if (r == rank)
+      continue;
+    if (leaders[r] == leader)
+      localWorkers.push_back(r);
+    else
+      remoteWorkers.push_back(r);
+  }
+
+  std::vector<int> nodes(leaders);
+  std::sort(nodes.begin(), nodes.end());
+  nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+  numNodes = nodes.size();
+  nodeId = std::lower_bound(nodes.begin(), nodes.end(), leader) - nodes.begin();
+
+  if (groupSize)
+    makeGroups(leaders, groupSize);
+}
+
+namespace {
+  //pieces of a coordinator and up to groupSize workers, a lone rank left
+  //at the end joins the piece before it or is returned in rest
+  void cutGroups(const std::vector<int> &ranks, unsigned groupSize,
+                 std::vector<std::vector<int> > &pieces, std::vector<int> &rest) {
+    unsigned first = pieces.size();
+    for (unsigned i = 0; i < ranks.size(); i += groupSize + 1) {
+      unsigned end = std::min((unsigned) ranks.size(), i + groupSize + 1);
+      if (end - i > 1)
+        pieces.push_back(std::vector<int>(ranks.begin() + i, ranks.begin() + end));
+      else if (pieces.size() > first)
+        pieces.back().push_back(ranks[i]);
+      else
+        rest.push_back(ranks[i]);
+    }
+  }
+}
+
+void NodeTopology::makeGroups(const std::vector<int> &leaders,
+                              unsigned groupSize) {
+  //groups stay within a node, the workers alone on theirs are grouped
+  //across nodes
+  std::map<int, std::vector<int> > byNode;
+  for (unsigned r = 2; r < leaders.size(); ++r)
+    byNode[leaders[r]].push_back(r);
+  std::vector<std::vector<int> > pieces;
+  std::vector<int> rest, unused;
+  for (std::map<int, std::vector<int> >::iterator it = byNode.begin(),
+         ie = byNode.end(); it != ie; ++it)
+    cutGroups(it->second, groupSize, pieces, rest);
+  cutGroups(rest, groupSize, pieces, unused);
+  //every worker needs a coordinator, or nobody gets one
+  if (pieces.empty())
+    return;
+  if (!unused.empty())
+    pieces.back().push_back(unused.front());
+
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  for (unsigned i = 0; i < pieces.size(); ++i) {
+    coordinators.push_back(pieces[i][0]);
+    std::vector<int>::iterator at =
+      std::find(pieces[i].begin(), pieces[i].end(), rank);
+    if (at == pieces[i].begin())
+      group.assign(pieces[i].begin() + 1, pieces[i].end());
+    else if (at != pieces[i].end())
+      coordinator = pieces[i][0];
+  }
+}
+
+NodeTopology::~NodeTopology() {
+  if (nodeComm != MPI_COMM_NULL)
+    MPI_Comm_free(&nodeComm);
+}
+
+void NodeTopology::initialize(unsigned groupSize) {
+  theNodeTopology = new NodeTopology(groupSize);
+}
+
+void NodeTopology::finalize() {
+  delete theNodeTopology;
+  theNodeTopology = 0;
+}
@@ -0,0 +1,73 @@
+//===-- NodeTopology.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Which ranks share a node. Work moved between them goes through shared
+// memory instead of the network, so the workers of a node balance among
+// themselves before looking further.
+//
+// With -group-size the workers of a node are also cut into groups, the
+// lowest rank of a group coordinates the others instead of exploring and
+// only its coordinator talks to the master.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_NODETOPOLOGY_H
+#define KLEE_NODETOPOLOGY_H
+
+#include <vector>
+#include <mpi.h>
+
+namespace klee {
+
+class NodeTopology {
+  MPI_Comm nodeComm;
+  int nodeId, numNodes;
+
+  /// world ranks of the workers (ranks 2..) on this node, this one excluded
+  std::vector<int> localWorkers;
+  std::vector<int> remoteWorkers;
+
+  /// the rank this one reports to, 0 for the master
+  int coordinator;
+  /// the workers of this rank's group if it coordinates one, and every
+  /// coordinator (on all ranks)
+  std::vector<int> group, coordinators;
+
+  NodeTopology(unsigned groupSize);
+
+  void makeGroups(const std::vector<int> &leaders, unsigned groupSize);
+
+public:
+  ~NodeTopology();
+
+  MPI_Comm getNodeComm() const { return nodeComm; }
+  /// Nodes are numbered by their lowest world rank.
+  int getNodeId() const { return nodeId; }
+  int getNumNodes() const { return numNodes; }
+
+  const std::vector<int> &getLocalWorkers() const { return localWorkers; }
+  const std::vector<int> &getRemoteWorkers() const { return remoteWorkers; }
+
+  bool hasGroups() const { return !coordinators.empty(); }
+  int getCoordinator() const { return coordinator; }
+  bool isCoordinator() const { return !group.empty(); }
+  const std::vector<int> &getGroup() const { return group; }
+  const std::vector<int> &getCoordinators() const { return coordinators; }
+
+  /// Collective over MPI_COMM_WORLD, every rank has to call it right
+  /// after MPI_Init. Sets theNodeTopology, \param groupSize workers per
+  /// coordinator, 0 for none.
+  static void initialize(unsigned groupSize = 0);
+  static void finalize();
+};
+
+  extern NodeTopology *theNodeTopology;
+}
+
+#endif
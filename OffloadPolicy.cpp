@@ -0,0 +1,211 @@
+//===-- OffloadPolicy.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "OffloadPolicy.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <ostream>
+
+using namespace llvm;
+using namespace klee;
+
+//replay cost of an offloaded state in instructions, the receiver re-runs
+//every branch of the prefix, re-adds its constraints and may have to take
+//the recoveries again
+#define REPLAY_BRANCH_COST 50
+#define REPLAY_CONSTRAINT_COST 10
+#define REPLAY_RECOVERY_COST 1000
+
+//pools smaller than this are never split
+#define MIN_OFFLOAD_POOL 4
+
+namespace {
+  cl::opt<double>
+  MinOffloadWork("min-offload-work",
+                 cl::desc("Refuse offload requests whose estimated work, in "
+                          "instructions, is below this (default=0)"),
+                 cl::init(0));
+
+  cl::opt<unsigned>
+  MaxOffloadDepth("max-offload-depth",
+                  cl::desc("Never give away states deeper than this many branches, "
+                           "their prefix costs more to replay on the receiver than "
+                           "to keep exploring here (default=0 (no limit))"),
+                  cl::init(0));
+
+  bool shallower(const OffloadCandidate &a, const OffloadCandidate &b) {
+    return a.depth < b.depth;
+  }
+
+  //legacy behaviour, the first states of the executor's set
+  class DefaultPolicy : public OffloadPolicy {
+  public:
+    const char *getName() const { return "DEFAULT"; }
+
+    void pick(std::vector<OffloadCandidate> &candidates, unsigned idleRanks,
+              unsigned donors, OffloadDecision &d) {
+      if (candidates.size() < MIN_OFFLOAD_POOL)
+        return;
+      unsigned n = defaultCount(candidates.size());
+      for (unsigned i = 0; i < n; ++i)
+        take(candidates[i], false, d);
+    }
+  };
+
+  //the shallowest states root the largest subtrees
+  class ShallowestFirstPolicy : public OffloadPolicy {
+  public:
+    const char *getName() const { return "SHALLOW"; }
+
+    void pick(std::vector<OffloadCandidate> &candidates, unsigned idleRanks,
+              unsigned donors, OffloadDecision &d) {
+      if (candidates.size() < MIN_OFFLOAD_POOL)
+        return;
+      std::stable_sort(candidates.begin(), candidates.end(), shallower);
+      unsigned n = defaultCount(candidates.size());
+      for (unsigned i = 0; i < n; ++i)
+        take(candidates[i], true, d);
+    }
+  };
+
+  //best expected work net of the replay cost first
+  class CostModelPolicy : public OffloadPolicy {
+    struct ByGain {
+      const CostModelPolicy *p;
+      bool operator()(const OffloadCandidate &a, const OffloadCandidate &b) const {
+        return p->gain(a) > p->gain(b);
+      }
+    };
+
+  public:
+    const char *getName() const { return "COST"; }
+
+    double gain(const OffloadCandidate &c) const {
+      return estimateWork(c) - estimateReplayCost(c);
+    }
+
+    void pick(std::vector<OffloadCandidate> &candidates, unsigned idleRanks,
+              unsigned donors, OffloadDecision &d) {
+      if (candidates.size() < MIN_OFFLOAD_POOL)
+        return;
+      ByGain cmp = { this };
+      std::stable_sort(candidates.begin(), candidates.end(), cmp);
+      unsigned n = defaultCount(candidates.size());
+      for (unsigned i = 0; i < n; ++i) {
+        if (gain(candidates[i]) <= 0)
+          break;
+        take(candidates[i], true, d);
+      }
+    }
+  };
+
+  //gives away the share of the idle ranks, between an eighth and half of
+  //the pool
+  class AdaptiveFractionPolicy : public OffloadPolicy {
+  public:
+    const char *getName() const { return "ADAPTIVE"; }
+
+    void pick(std::vector<OffloadCandidate> &candidates, unsigned idleRanks,
+              unsigned donors, OffloadDecision &d) {
+      if (candidates.size() < 2)
+        return;
+      double fraction = (double) idleRanks / (idleRanks + std::max(donors, 1u));
+      fraction = std::min(0.5, std::max(0.125, fraction));
+      unsigned n = std::max(1u, (unsigned) (candidates.size() * fraction));
+      std::stable_sort(candidates.begin(), candidates.end(), shallower);
+      for (unsigned i = 0; i < n; ++i)
+        take(candidates[i], true, d);
+    }
+
+    bool isReady(unsigned numStates, bool wasReady) const {
+      return numStates >= 2;
+    }
+  };
+}
+
+double OffloadPolicy::estimateWork(const OffloadCandidate &c) const {
+  return (maxDepth - c.depth + 1) * instsPerLevel;
+}
+
+double OffloadPolicy::estimateReplayCost(const OffloadCandidate &c) const {
+  return (double) c.depth * REPLAY_BRANCH_COST +
+         (double) c.numConstraints * REPLAY_CONSTRAINT_COST +
+         (double) c.pendingRecoveries * REPLAY_RECOVERY_COST;
+}
+
+void OffloadPolicy::take(const OffloadCandidate &c, bool dropUnprofitable,
+                         OffloadDecision &d) const {
+  //states only move by replaying their prefix from main on the receiver
+  if (MaxOffloadDepth && c.depth > MaxOffloadDepth)
+    return;
+  double work = estimateWork(c), replay = estimateReplayCost(c);
+  if (dropUnprofitable && work <= replay)
+    return;
+  d.states.push_back(c.state);
+  d.work += work;
+  d.replayCost += replay;
+}
+
+unsigned OffloadPolicy::defaultCount(unsigned poolSize) {
+  return poolSize > 64 ? 16 : poolSize / 4;
+}
+
+bool OffloadPolicy::isReady(unsigned numStates, bool wasReady) const {
+  //same cut-offs as before, 8 to become ready and 4 to stop
+  return wasReady ? numStates >= 4 : numStates >= 8;
+}
+
+OffloadDecision OffloadPolicy::select(std::vector<OffloadCandidate> &candidates,
+                                      unsigned idleRanks, unsigned donors,
+                                      unsigned depthBound) {
+  OffloadDecision d;
+  ++requests;
+  if (!candidates.empty()) {
+    //the pool's own deepest state is only a lower bound, on a DFS frontier
+    //it sits right below the others
+    maxDepth = depthBound;
+    uint64_t insts = 0;
+    for (std::vector<OffloadCandidate>::const_iterator it = candidates.begin(),
+           ie = candidates.end(); it != ie; ++it) {
+      maxDepth = std::max(maxDepth, it->depth);
+      insts += it->instsSinceFork;
+    }
+    instsPerLevel = std::max(1.0, (double) insts / candidates.size());
+    pick(candidates, std::max(idleRanks, 1u), donors, d);
+  }
+
+  if (d.states.empty() || d.work < MinOffloadWork) {
+    ++refused;
+    return OffloadDecision();
+  }
+  statesSent += d.states.size();
+  workSent += d.work;
+  replaySent += d.replayCost;
+  return d;
+}
+
+void OffloadPolicy::printStats(std::ostream &os) const {
+  os << "Offload Policy: " << getName() << " Requests: " << requests
+     << " Refused: " << refused << " States: " << statesSent
+     << " Work: " << workSent << " Replay: " << replaySent << "\n";
+}
+
+OffloadPolicy *OffloadPolicy::create(const std::string &name) {
+  if (name == "DEFAULT")
+    return new DefaultPolicy();
+  if (name == "SHALLOW")
+    return new ShallowestFirstPolicy();
+  if (name == "COST")
+    return new CostModelPolicy();
+  if (name == "ADAPTIVE")
+    return new AdaptiveFractionPolicy();
+  return NULL;
+}
@@ -0,0 +1,106 @@
+//===-- OffloadPolicy.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Selection of the states a worker gives away when the master (or a peer)
+// asks it to offload, chosen with -offloadPolicy.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_OFFLOADPOLICY_H
+#define KLEE_OFFLOADPOLICY_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace klee {
+  class ExecutionState;
+
+/// What the executor knows about a state that could be offloaded.
+struct OffloadCandidate {
+  ExecutionState *state;
+  /// branch decisions the receiver has to replay
+  unsigned depth;
+  /// instructions executed by the worker since the state was forked
+  uint64_t instsSinceFork;
+  /// skipped functions whose side effects may still need a recovery
+  unsigned pendingRecoveries;
+  unsigned numConstraints;
+};
+
+/// The states picked by a policy and the estimated work they carry, in
+/// instructions.
+struct OffloadDecision {
+  std::vector<ExecutionState *> states;
+  double work;
+  double replayCost;
+
+  OffloadDecision() : work(0), replayCost(0) {}
+};
+
+class OffloadPolicy {
+protected:
+  uint64_t requests, refused, statesSent;
+  double workSent, replaySent;
+
+  /// depth the subtrees of the current request reach and average
+  /// instructions per level of its pool
+  unsigned maxDepth;
+  double instsPerLevel;
+
+  /// Expected work below \param c, linear in the levels left above the
+  /// depth the subtrees reach.
+  double estimateWork(const OffloadCandidate &c) const;
+  double estimateReplayCost(const OffloadCandidate &c) const;
+
+  /// Adds \param c to \param d, states whose subtree is cheaper to explore
+  /// here than to replay remotely are skipped when \param dropUnprofitable
+  /// is set.
+  void take(const OffloadCandidate &c, bool dropUnprofitable,
+            OffloadDecision &d) const;
+
+  /// The legacy amount: 16 states out of large pools, a quarter otherwise.
+  static unsigned defaultCount(unsigned poolSize);
+
+  virtual void pick(std::vector<OffloadCandidate> &candidates,
+                    unsigned idleRanks, unsigned donors,
+                    OffloadDecision &d) = 0;
+
+public:
+  OffloadPolicy()
+    : requests(0), refused(0), statesSent(0), workSent(0), replaySent(0),
+      maxDepth(0), instsPerLevel(1) {}
+  virtual ~OffloadPolicy() {}
+
+  virtual const char *getName() const = 0;
+
+  /// Hysteresis on the number of states, decides when the worker reports
+  /// itself ready to the master.
+  virtual bool isReady(unsigned numStates, bool wasReady) const;
+
+  /// Chooses the states to give to one of \param idleRanks free workers,
+  /// \param donors workers are being asked at the same time. The paths
+  /// below the candidates are expected to reach \param depthBound, the
+  /// phase 2 depth or the deepest path seen, 0 if neither is known. An
+  /// empty decision means the request is refused.
+  OffloadDecision select(std::vector<OffloadCandidate> &candidates,
+                         unsigned idleRanks, unsigned donors,
+                         unsigned depthBound);
+
+  /// Totals over all the requests this worker served.
+  void printStats(std::ostream &os) const;
+
+  /// Returns NULL for an unknown \param name.
+  static OffloadPolicy *create(const std::string &name);
+};
+
+}
+
+#endif
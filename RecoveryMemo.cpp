@@ -0,0 +1,95 @@
+//===-- RecoveryMemo.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RecoveryMemo.h"
+
+#include "klee/Constraints.h"
+
+#include <algorithm>
+#include <set>
+
+using namespace klee;
+
+//snapshots followed, and paths kept per slice and load, the memo is
+//dropped as a whole when it grows past them
+#define RECOVERY_MEMO_LIMIT 4096
+#define RECOVERY_RESULTS_LIMIT 8
+
+//entries kept before the first sweep, later the memo may double between two
+#define RECOVERY_MEMO_MIN_SWEEP 64
+
+bool RecoveryMemo::Key::operator<(const Key &other) const {
+  if (snapshot != other.snapshot)
+    return snapshot < other.snapshot;
+  if (sliceId != other.sliceId)
+    return sliceId < other.sliceId;
+  if (loadAddr != other.loadAddr)
+    return loadAddr < other.loadAddr;
+  return loadSize < other.loadSize;
+}
+
+RecoveryMemo::RecoveryMemo() : sweepAt(RECOVERY_MEMO_MIN_SWEEP) {}
+
+void RecoveryMemo::sweep() {
+  //a snapshot has one reference per entry it keys, the memo's own
+  std::map<const Snapshot *, unsigned> held;
+  for (std::map<Key, Entry>::iterator it = entries.begin();
+       it != entries.end(); ++it)
+    held[it->first.snapshot]++;
+
+  for (std::map<Key, Entry>::iterator it = entries.begin();
+       it != entries.end();) {
+    if (it->second.snapshot->refCount == held[it->first.snapshot])
+      entries.erase(it++);
+    else
+      ++it;
+  }
+  sweepAt = std::max((size_t) RECOVERY_MEMO_MIN_SWEEP, 2 * entries.size());
+}
+
+RecoveryMemo::Key RecoveryMemo::makeKey(const RecoveryInfo &ri) {
+  Key key;
+  key.snapshot = ri.snapshot.get();
+  key.sliceId = ri.sliceId;
+  key.loadAddr = ri.loadAddr;
+  key.loadSize = ri.loadSize;
+  return key;
+}
+
+void RecoveryMemo::insert(const RecoveryInfo &ri,
+                          const ConstraintManager &constraints,
+                          ref<Expr> value) {
+  //what the path added to the snapshot, rewritten constraints included
+  const ConstraintManager &start = ri.snapshot->state->constraints;
+  std::set<ref<Expr> > known(start.begin(), start.end());
+  Result result;
+  for (ConstraintManager::const_iterator it = constraints.begin(),
+         ie = constraints.end(); it != ie; ++it) {
+    if (!known.count(*it))
+      result.conditions.push_back(*it);
+  }
+  result.value = value;
+
+  if (entries.size() >= sweepAt)
+    sweep();
+  if (entries.size() >= RECOVERY_MEMO_LIMIT)
+    entries.clear();
+  Entry &entry = entries[makeKey(ri)];
+  entry.snapshot = ri.snapshot;
+  if (entry.results.size() < RECOVERY_RESULTS_LIMIT)
+    entry.results.push_back(result);
+}
+
+const std::vector<RecoveryMemo::Result> *
+RecoveryMemo::find(const RecoveryInfo &ri) const {
+  std::map<Key, Entry>::const_iterator it = entries.find(makeKey(ri));
+  if (it == entries.end())
+    return NULL;
+  return &it->second.results;
+}
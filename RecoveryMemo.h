@@ -0,0 +1,77 @@
+//===-- RecoveryMemo.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Results of completed recoveries, shared by every state that forked after
+// the same snapshot. A result holds the value the slice wrote to the blocking
+// load (null if it wrote nothing) and the conditions of the recovery path
+// beyond the snapshot; a state whose constraints imply them gets the same
+// value without running the slice.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_RECOVERYMEMO_H
+#define KLEE_RECOVERYMEMO_H
+
+#include "klee/ExecutionState.h"
+#include "klee/Expr.h"
+
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+namespace klee {
+  class ConstraintManager;
+
+class RecoveryMemo {
+public:
+  struct Result {
+    std::vector<ref<Expr> > conditions;
+    ref<Expr> value;
+  };
+
+private:
+  struct Key {
+    const Snapshot *snapshot;
+    uint32_t sliceId;
+    uint64_t loadAddr, loadSize;
+
+    bool operator<(const Key &other) const;
+  };
+
+  struct Entry {
+    /// keeps the snapshot, and so the key, alive
+    ref<Snapshot> snapshot;
+    std::vector<Result> results;
+  };
+
+  std::map<Key, Entry> entries;
+  size_t sweepAt;
+
+  static Key makeKey(const RecoveryInfo &ri);
+
+public:
+  RecoveryMemo();
+
+  /// Drops the entries of the snapshots no live state refers to any more,
+  /// only the memo would keep them alive.
+  void sweep();
+
+  /// Records the result of a recovery for \param ri that reached its exit
+  /// with \param constraints.
+  void insert(const RecoveryInfo &ri, const ConstraintManager &constraints,
+              ref<Expr> value);
+
+  /// The results recorded for the slice, snapshot and load of \param ri,
+  /// NULL if there is none.
+  const std::vector<Result> *find(const RecoveryInfo &ri) const;
+};
+
+}
+
+#endif
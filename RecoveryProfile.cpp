@@ -0,0 +1,80 @@
+//===-- RecoveryProfile.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RecoveryProfile.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+//normal instructions over which the waiting suspended states should be
+//recovered, a shorter horizon gives the recoveries a larger share
+#define RECOVERY_HORIZON 100000
+
+//share used before any recovery has been measured, and its bounds
+#define DEFAULT_RECOVERY_SHARE 50
+#define MIN_RECOVERY_SHARE 5
+#define MAX_RECOVERY_SHARE 95
+
+RecoveryProfile::SliceStats &RecoveryProfile::getStats(const SliceKey &key) {
+  if (!lastStats || lastKey != key) {
+    lastKey = key;
+    lastStats = &slices[key];
+  }
+  return *lastStats;
+}
+
+void RecoveryProfile::onRecoveryStarted(const SliceKey &key) {
+  ++getStats(key).started;
+  ++started;
+}
+
+void RecoveryProfile::onRecoveryInstruction(const SliceKey &key) {
+  ++getStats(key).instructions;
+  ++recoveryInstructions;
+}
+
+void RecoveryProfile::onDependentResumed(const SliceKey &key) {
+  ++getStats(key).resumed;
+  ++resumed;
+}
+
+double RecoveryProfile::getYield(const SliceKey &key) const {
+  std::map<SliceKey, SliceStats>::const_iterator it = slices.find(key);
+  if (it == slices.end() || !it->second.instructions)
+    return getAverageYield();
+  return 1000.0 * it->second.resumed / it->second.instructions;
+}
+
+double RecoveryProfile::getAverageYield() const {
+  if (!recoveryInstructions)
+    return 0;
+  return 1000.0 * resumed / recoveryInstructions;
+}
+
+unsigned RecoveryProfile::getRecoveryShare(unsigned pendingSuspended) const {
+  if (!normalInstructions || !recoveryInstructions)
+    return DEFAULT_RECOVERY_SHARE;
+  //recovery instructions per normal one so far, plus what clearing the
+  //waiting states within the horizon takes at the current yield
+  double need = (double) recoveryInstructions / normalInstructions;
+  double perResume = resumed ? (double) recoveryInstructions / resumed
+                             : (double) recoveryInstructions;
+  need += pendingSuspended * perResume / RECOVERY_HORIZON;
+  unsigned share = (unsigned) (100 * need / (1 + need));
+  return std::min((unsigned) MAX_RECOVERY_SHARE,
+                  std::max((unsigned) MIN_RECOVERY_SHARE, share));
+}
+
+unsigned RecoveryProfile::getExpectedResumes(unsigned pendingSuspended) const {
+  if (!started)
+    return 0;
+  double rate = std::min(1.0, (double) resumed / started);
+  return (unsigned) (pendingSuspended * rate);
+}
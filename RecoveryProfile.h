@@ -0,0 +1,79 @@
+//===-- RecoveryProfile.h ---------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Cost and yield of the recoveries of each slice, drives the split between
+// normal and recovery states with -adaptive-recovery-split.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_RECOVERYPROFILE_H
+#define KLEE_RECOVERYPROFILE_H
+
+#include <map>
+#include <utility>
+#include <stdint.h>
+
+namespace llvm {
+  class Function;
+}
+
+namespace klee {
+
+class RecoveryProfile {
+public:
+  /// skipped function and slice id of a recovery
+  typedef std::pair<const llvm::Function *, uint32_t> SliceKey;
+
+private:
+  struct SliceStats {
+    uint64_t started, instructions, resumed;
+
+    SliceStats() : started(0), instructions(0), resumed(0) {}
+  };
+
+  std::map<SliceKey, SliceStats> slices;
+
+  /// last slice touched, consecutive instructions mostly come from the
+  /// same recovery
+  SliceKey lastKey;
+  SliceStats *lastStats;
+
+  uint64_t normalInstructions, recoveryInstructions;
+  uint64_t started, resumed;
+
+  SliceStats &getStats(const SliceKey &key);
+
+public:
+  RecoveryProfile()
+    : lastKey(0, 0), lastStats(0), normalInstructions(0),
+      recoveryInstructions(0), started(0), resumed(0) {}
+
+  void onRecoveryStarted(const SliceKey &key);
+  void onNormalInstruction() { ++normalInstructions; }
+  void onRecoveryInstruction(const SliceKey &key);
+  /// A state suspended on \param key runs again.
+  void onDependentResumed(const SliceKey &key);
+
+  /// Dependents resumed per thousand recovery instructions, recoveries not
+  /// measured yet get the average.
+  double getYield(const SliceKey &key) const;
+  double getAverageYield() const;
+
+  /// Share of the selections, in percent, the recovery states need for the
+  /// resumptions to keep pace with the suspensions. \param pendingSuspended
+  /// states waiting for a recovery raise it.
+  unsigned getRecoveryShare(unsigned pendingSuspended) const;
+
+  /// How many of \param pendingSuspended states are expected to run again.
+  unsigned getExpectedResumes(unsigned pendingSuspended) const;
+};
+
+}
+
+#endif
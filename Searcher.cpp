@@ -41,6 +41,7 @@
 #include "llvm/IR/CallSite.h"
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <climits>
@@ -57,9 +58,43 @@ namespace klee {
   extern RNG theRNG;
 }
 
+void IndexedStates::insert(ExecutionState *es) {
+  positions[es] = states.size();
+  states.push_back(es);
+}
+
+//the last state takes the place of the removed one
+bool IndexedStates::remove(ExecutionState *es) {
+  auto it = positions.find(es);
+  if (it == positions.end())
+    return false;
+  unsigned int pos = it->second;
+  positions.erase(it);
+  if (pos != states.size() - 1) {
+    states[pos] = states.back();
+    positions[states[pos]] = pos;
+  }
+  states.pop_back();
+  return true;
+}
+
+///
+
 Searcher::~Searcher() {
 }
 
+void Searcher::countAdded(ExecutionState *es) {
+  if (!es->isRecoveryState())
+    ++numOffloadable;
+}
+
+void Searcher::countRemoved(ExecutionState *es) {
+  if (!es->isRecoveryState()) {
+    assert(numOffloadable > 0);
+    --numOffloadable;
+  }
+}
+
 ///
 
 ExecutionState &DFSSearcher::selectState() {
@@ -69,195 +104,106 @@ ExecutionState &DFSSearcher::selectState() {
 void DFSSearcher::update(ExecutionState *current,
                          const std::vector<ExecutionState *> &addedStates,
                          const std::vector<ExecutionState *> &removedStates) {
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
+  for (std::vector<ExecutionState *>::const_iterator it = addedStates.begin(),
+                                                     ie = addedStates.end();
+       it != ie; ++it) {
+    states.push_back(*it);
+    handles[*it] = --states.end();
+    countAdded(*it);
+  }
   for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
                                                      ie = removedStates.end();
        it != ie; ++it) {
-    ExecutionState *es = *it;
-    if (es == states.back()) {
-      states.pop_back();
-    } else {
-      bool ok = false;
-
-      for (std::vector<ExecutionState*>::iterator it = states.begin(),
-             ie = states.end(); it != ie; ++it) {
-        if (es==*it) {
-          states.erase(it);
-          ok = true;
-          break;
-        }
-      }
-
-      assert(ok && "invalid state removed");
-    }
+    auto hit = handles.find(*it);
+    assert(hit != handles.end() && "invalid state removed");
+    states.erase(hit->second);
+    handles.erase(hit);
+    countRemoved(*it);
   }
 }
 
 ExecutionState* DFSSearcher::getState2Offload() {
-  //ExecutionState *ptr2State = states[theRNG.getInt32()%states.size()];
-  ExecutionState *ptr2State = states[0];
-  ExecutionState retState = *ptr2State;
-  return ptr2State;
+  return states.front();
 }
 
-///
-
-BFSSearcher::BFSSearcher() {
-  currentMinDepth = 0;
-  depthStatesMap.clear();
-  depthMap.clear();
-}
-
-BFSSearcher::~BFSSearcher() {
+void DFSSearcher::getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+  for (auto it = states.begin(); it != states.end() && k; ++it) {
+    if (!(*it)->isRecoveryState()) {
+      out.push_back(*it);
+      --k;
+    }
+  }
 }
 
+///
 
-//ExecutionState &BFSSearcher::getState2Offload() {
-//}
-
-ExecutionState* BFSSearcher::getState2Offload() {
-  assert(depthStatesMap.find(currentMinDepth) != depthStatesMap.end());
-  return (depthStatesMap[currentMinDepth][theRNG.getInt32()%depthStatesMap[currentMinDepth].size()]);
+//States are bucketed by actDepth rather than kept in one queue: a switch
+//adds all its successors in one go, each a level deeper, so a state of
+//depth 4 can arrive before a state of depth 2 from the next switch.
+//Buckets are lists so that a state is removed through its handle in O(1).
+void BFSSearcher::insertState(ExecutionState *es) {
+  Bucket &bucket = buckets[es->actDepth];
+  bucket.push_back(es);
+  handles[es] = std::make_pair((unsigned) es->actDepth, --bucket.end());
+  countAdded(es);
+}
+
+void BFSSearcher::removeState(ExecutionState *es) {
+  auto hit = handles.find(es);
+  assert(hit != handles.end() && "invalid state removed");
+  auto bit = buckets.find(hit->second.first);
+  assert(bit != buckets.end());
+  bit->second.erase(hit->second.second);
+  if (bit->second.empty())
+    buckets.erase(bit);
+  handles.erase(hit);
+  countRemoved(es);
 }
 
-ExecutionState &BFSSearcher::selectState() {
-  //std::cout<<"YT Calling Select State Minimum Depth: "<<currentMinDepth<<"\n";
-  //std::cout.flush();
-  assert(depthStatesMap.find(currentMinDepth) != depthStatesMap.end());
-  return *((depthStatesMap[currentMinDepth]).front());
-}
-
-//The switch statement adds all the states corresponding to each of the case
-//statments in one go. Each case has an increasing depth. Now If say there are
-//multiple switch statements, a state of depth 4 will be added before the
-//a state of depth 2 in the following switch stament which breaks the BFS
-//search, so I need to reimplement the BFS search again to accomodate this case
-//There is map which maps the depth to the deque of states of that depth
-void BFSSearcher::update(ExecutionState *current,
-    const std::vector<ExecutionState *> &addedStates,
-    const std::vector<ExecutionState *> &removedStates) {
-
-  //std::cout << "SS_Searcher: Calling updatestate BFS \n";
-  //std::cout.flush();;
-  if(current != nullptr) {
-    auto mit = depthMap.find(current);
-    if (mit == depthMap.end()) {
-      //if the state doesnt exist for some reason just put it 
-      //in and update it
-      depthMap[current] = current->actDepth;
-      insertIntoDepthStateMap(current);
-      //std::cout << "YT Inserting State "<<current<<" at depth "<<current->actDepth<<"\n";
-    } else {
-      //if it exists and the depth has changed, if yes update it
-      if (depthMap[current] != current->actDepth) {
-        //std::cout << "YT Updating State "<<current<<" from depth "<<depthMap[current]
-        //          << " to depth " << current->actDepth<<"\n";
-        updateDepthStateMap(current, depthMap[current]);
-        depthMap[current] = current->actDepth;
+ExecutionState* BFSSearcher::getState2Offload() {
+  assert(!buckets.empty());
+  Bucket &bucket = buckets.begin()->second;
+  auto it = bucket.begin();
+  std::advance(it, theRNG.getInt32() % bucket.size());
+  return *it;
+}
+
+void BFSSearcher::getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+  for (auto bit = buckets.begin(); bit != buckets.end() && k; ++bit) {
+    for (auto it = bit->second.begin(); it != bit->second.end() && k; ++it) {
+      if (!(*it)->isRecoveryState()) {
+        out.push_back(*it);
+        --k;
       }
     }
   }
-
-  //removing the removed states
-  //std::cout << "SS_Searcher: Removing states BFS \n";
-  for(auto it = removedStates.begin(); it != removedStates.end(); ++it) {
-    removeFromDepthStateMap(*it);
-  }
-  //adding the new states
-  //std::cout << "SS_Searcher: Adding states BFS \n";
-  for(auto it = addedStates.begin(); it != addedStates.end(); ++it) {
-    insertIntoDepthStateMap(*it);
-  }
 }
 
-void BFSSearcher::insertIntoDepthStateMap(ExecutionState* current) {
-  auto it2 = std::find(states.begin(), states.end(), current);
-  if(it2 == states.end()) {
-    states.push_back(current);
-  }
-  int depth = current->actDepth;
-  if(depthMap.size() == 0) { //first state
-    currentMinDepth = current->actDepth;
-    //depthMap.clear();
-    //depthStatesMap.clear();
-  }
-  depthMap[current] = depth;
-  if(depthStatesMap.find(depth) == depthStatesMap.end()) {
-    std::deque<ExecutionState*> newListofStates;
-    newListofStates.push_back(current);
-    depthStatesMap[depth] = newListofStates;
-    if(currentMinDepth > current->actDepth) {
-      currentMinDepth = current->actDepth;
-    }
-    //std::cout << "YT Adding first state "<<current<<" depth "<<depth<<" "<<current<<"\n";
-    //std::cout.flush();
-  } else {
-    auto listofStates= depthStatesMap[depth];
-    listofStates.push_back(current);
-    depthStatesMap[depth] = listofStates;
-    //std::cout << "YT Adding state "<<current<<" depth "<<depth<<" "<<current<<"\n";
-    //std::cout.flush();
-  }
+ExecutionState &BFSSearcher::selectState() {
+  assert(!buckets.empty());
+  return *buckets.begin()->second.front();
 }
 
-void BFSSearcher::removeFromDepthStateMap(ExecutionState* current) {
-  //assert(depthMap.find(current) != depthMap.end());
-  auto it2 = std::find(states.begin(), states.end(), current);
-  assert(it2!=states.end());
-  states.erase(it2);
-  int oldDepth = depthMap[current];
-  int depth = current->actDepth;
-  //std::cout << "YT Trying Removing state "<<current<<" depth "<<depth<<" "<<current<<"\n";
-  //std::cout.flush();
-  assert(depthStatesMap.find(oldDepth) != depthStatesMap.end());
-  auto listofStates = depthStatesMap[oldDepth];
-  auto it = std::find(listofStates.begin(), listofStates.end(), current);
-  assert(it!=listofStates.end());
-  listofStates.erase(it);
-  //here check if the list is empty
-  if(listofStates.size() == 0) {
-    depthStatesMap.erase(oldDepth);
-    //std::cout << "YT Removing last state "<<current<<" depth "<<depth<<"\n";
-    //std::cout.flush();
-    if (oldDepth == currentMinDepth) {
-      int found = false;
-      //currentMinDepth++;
-      int tryDepth = currentMinDepth + 1;
-      while(depthStatesMap.find(tryDepth) == depthStatesMap.end()) {
-        //std::cout << "Trying for a new depth: "<<tryDepth<<"\n";
-        tryDepth++;  
-      } 
-      currentMinDepth = tryDepth;
-      //std::cout << "YT New Minimum Depth  "<< currentMinDepth <<"\n";
-      //std::cout.flush();
+void BFSSearcher::update(ExecutionState *current,
+    const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  if (current != nullptr) {
+    auto hit = handles.find(current);
+    if (hit == handles.end()) {
+      insertState(current);
+    } else if (hit->second.first != (unsigned) current->actDepth) {
+      //it went deeper, it queues behind the states of its new depth
+      removeState(current);
+      insertState(current);
     }
-  } else {
-    depthStatesMap[oldDepth] = listofStates;
-    //std::cout << "YT Removing state "<<current<<" depth "<<depth<<"\n";
-    //std::cout.flush();
   }
-  depthMap.erase(current);
-}
-
-void BFSSearcher::updateDepthStateMap(ExecutionState* current, int oldDepth) {
-  int newDepth = current->actDepth;
-  assert(depthStatesMap.find(oldDepth) != depthStatesMap.end());
-  //erase from the old list
-  auto listofStates = depthStatesMap[oldDepth];
-  auto it = std::find(listofStates.begin(), listofStates.end(), current);
-  assert(it!=listofStates.end());
-  listofStates.erase(it);
-  if (listofStates.size() == 0) {
-    depthStatesMap.erase(oldDepth);
-    if (currentMinDepth <= oldDepth)
-      //currentMinDepth = oldDepth+1;
-      currentMinDepth = newDepth;
-  } else {
-    depthStatesMap[oldDepth] = listofStates;
+
+  for (auto it = removedStates.begin(); it != removedStates.end(); ++it)
+    removeState(*it);
+  for (auto it = addedStates.begin(); it != addedStates.end(); ++it) {
+    if (handles.find(*it) == handles.end())
+      insertState(*it);
   }
-  insertIntoDepthStateMap(current);
 }
 
 ///
@@ -270,25 +216,18 @@ void
 RandomSearcher::update(ExecutionState *current,
                        const std::vector<ExecutionState *> &addedStates,
                        const std::vector<ExecutionState *> &removedStates) {
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
+  for (std::vector<ExecutionState *>::const_iterator it = addedStates.begin(),
+                                                     ie = addedStates.end();
+       it != ie; ++it) {
+    states.insert(*it);
+    countAdded(*it);
+  }
   for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
                                                      ie = removedStates.end();
        it != ie; ++it) {
-    ExecutionState *es = *it;
-    bool ok = false;
-
-    for (std::vector<ExecutionState*>::iterator it = states.begin(),
-           ie = states.end(); it != ie; ++it) {
-      if (es==*it) {
-        states.erase(it);
-        ok = true;
-        break;
-      }
-    }
-    
+    bool ok = states.remove(*it);
     assert(ok && "invalid state removed");
+    countRemoved(*it);
   }
 }
 
@@ -296,6 +235,16 @@ ExecutionState* RandomSearcher::getState2Offload() {
   return states[0];
 }
 
+//any order is as good as another
+void RandomSearcher::getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+  for (unsigned int i = 0; i < states.size() && k; ++i) {
+    if (!states[i]->isRecoveryState()) {
+      out.push_back(states[i]);
+      --k;
+    }
+  }
+}
+
 ///
 
 WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
@@ -375,15 +324,26 @@ void WeightedRandomSearcher::update(
        it != ie; ++it) {
     ExecutionState *es = *it;
     states->insert(es, getWeight(es));
+    members.insert(es);
+    countAdded(es);
   }
 
   for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
                                                      ie = removedStates.end();
        it != ie; ++it) {
     states->remove(*it);
+    if (members.remove(*it))
+      countRemoved(*it);
   }
 }
 
+void WeightedRandomSearcher::coverageChanged() {
+  if (!updateWeights)
+    return;
+  for (unsigned int i = 0; i < members.size(); ++i)
+    states->update(members[i], getWeight(members[i]));
+}
+
 bool WeightedRandomSearcher::empty() { 
   return states->empty(); 
 }
@@ -399,6 +359,20 @@ ExecutionState* WeightedRandomSearcher::getState2Offload() {
   return &state2Offload;
 }
 
+//the weights favour what we want to explore next, keep those
+void WeightedRandomSearcher::getOffloadCandidates(unsigned int k,
+                                                  std::vector<ExecutionState*> &out) {
+  std::vector<std::pair<double, ExecutionState*> > byWeight;
+  for (unsigned int i = 0; i < members.size(); ++i) {
+    if (!members[i]->isRecoveryState())
+      byWeight.push_back(std::make_pair(getWeight(members[i]), members[i]));
+  }
+  k = std::min(k, (unsigned int) byWeight.size());
+  std::partial_sort(byWeight.begin(), byWeight.begin() + k, byWeight.end());
+  for (unsigned int i = 0; i < k; ++i)
+    out.push_back(byWeight[i].second);
+}
+
 ///
 
 RandomPathSearcher::RandomPathSearcher(Executor &_executor)
@@ -438,6 +412,14 @@ void
 RandomPathSearcher::update(ExecutionState *current,
                            const std::vector<ExecutionState *> &addedStates,
                            const std::vector<ExecutionState *> &removedStates) {
+  for (auto it = addedStates.begin(); it != addedStates.end(); ++it) {
+    states.insert(*it);
+    countAdded(*it);
+  }
+  for (auto it = removedStates.begin(); it != removedStates.end(); ++it) {
+    if (states.remove(*it))
+      countRemoved(*it);
+  }
 }
 
 bool RandomPathSearcher::empty() { 
@@ -445,8 +427,17 @@ bool RandomPathSearcher::empty() {
 }
 
 ExecutionState* RandomPathSearcher::getState2Offload() {
-  ExecutionState* ff;
-  return ff;
+  return states.empty() ? NULL : states[0];
+}
+
+void RandomPathSearcher::getOffloadCandidates(unsigned int k,
+                                              std::vector<ExecutionState*> &out) {
+  for (unsigned int i = 0; i < states.size() && k; ++i) {
+    if (!states[i]->isRecoveryState()) {
+      out.push_back(states[i]);
+      --k;
+    }
+  }
 }
 
 ///
@@ -719,8 +710,7 @@ BatchingSearcher::update(ExecutionState *current,
 }
 
 ExecutionState* BatchingSearcher::getState2Offload() {
-      ExecutionState* ff;
-            return ff;
+  return baseSearcher->getState2Offload();
 }
 
 /***/
@@ -755,6 +745,7 @@ void IterativeDeepeningTimeSearcher::update(
       std::set<ExecutionState*>::const_iterator it2 = pausedStates.find(es);
       if (it2 != pausedStates.end()) {
         pausedStates.erase(it2);
+        countRemoved(es);
         alt.erase(std::remove(alt.begin(), alt.end(), es), alt.end());
       }
     }    
@@ -768,6 +759,7 @@ void IterativeDeepeningTimeSearcher::update(
           removedStates.end() &&
       elapsed > time) {
     pausedStates.insert(current);
+    countAdded(current);
     baseSearcher->removeState(current);
   }
 
@@ -777,6 +769,7 @@ void IterativeDeepeningTimeSearcher::update(
     std::vector<ExecutionState *> ps(pausedStates.begin(), pausedStates.end());
     baseSearcher->update(0, ps, std::vector<ExecutionState *>());
     pausedStates.clear();
+    numOffloadable = 0;
   }
 }
 
@@ -928,7 +921,7 @@ RandomRecoveryPath::~RandomRecoveryPath() {
 ExecutionState &RandomRecoveryPath::selectState() {
   if (treeStack.empty()) {
     /* as this point, the order of selection does not matter */
-    return *states.front();
+    return *states[0];
   }
 
   unsigned int flips = 0;
@@ -972,7 +965,8 @@ void RandomRecoveryPath::update(
     }
 
     /* add state */
-    states.push_back(es);
+    states.insert(es);
+    countAdded(es);
   }
   for (auto i = removedStates.begin(); i != removedStates.end(); i++) {
     ExecutionState *es = *i;
@@ -982,11 +976,8 @@ void RandomRecoveryPath::update(
     }
 
     /* remove state */
-    for (auto j = states.begin(); j != states.end(); j++) {
-      if (es == *j) {
-        states.erase(j);
-        break;
-      }
+    if (states.remove(es)) {
+      countRemoved(es);
     }
   }
 }
@@ -1010,7 +1001,8 @@ OptimizedSplittedSearcher::OptimizedSplittedSearcher(
   baseSearcher(baseSearcher),
   recoverySearcher(recoverySearcher),
   highPrioritySearcher(highPrioritySearcher),
-  ratio(ratio)
+  ratio(ratio),
+  adaptiveSplit(false)
 {
 
 }
@@ -1074,22 +1066,24 @@ void OptimizedSplittedSearcher::update(
   for (auto i = removedStates.begin(); i != removedStates.end(); i++) {
     ExecutionState *es = *i;
     if (es->isRecoveryState()) {
-      if (es->getPriority() == PRIORITY_HIGH) {
+      bool highPriority = es->getPriority() == PRIORITY_HIGH;
+      if (highPriority) {
         highPrioritySearcher->removeState(es);
-        /* flush the high priority recovery states, only when a root recovery state terminates */
-        if ((es->isResumed() && es->getLevel() == 0)) {
-          int count = 0;
-          while (!highPrioritySearcher->empty()) {
-            ExecutionState &rs = highPrioritySearcher->selectState();
-            highPrioritySearcher->removeState(&rs);
-            rs.setPriority(PRIORITY_LOW);
-            recoverySearcher->addState(&rs);
-            count++;
-          }
-        }
       } else {
         removedRecoveryStates.push_back(es);
       }
+      /* flush the high priority recovery states, only when a root recovery state terminates,
+       * with -adaptive-recovery-split the root itself may have had a low priority */
+      if ((highPriority || adaptiveSplit) && (es->isResumed() && es->getLevel() == 0)) {
+        int count = 0;
+        while (!highPrioritySearcher->empty()) {
+          ExecutionState &rs = highPrioritySearcher->selectState();
+          highPrioritySearcher->removeState(&rs);
+          rs.setPriority(PRIORITY_LOW);
+          recoverySearcher->addState(&rs);
+          count++;
+        }
+      }
     } else {
       removedOriginatingStates.push_back(es);
     }
@@ -1113,6 +1107,5 @@ bool OptimizedSplittedSearcher::empty() {
 }
 
 ExecutionState* OptimizedSplittedSearcher::getState2Offload() {
-  ExecutionState* ff;
-  return ff;
+  return baseSearcher->getState2Offload();
 }
@@ -14,6 +14,7 @@
 
 #include "llvm/Support/raw_ostream.h"
 #include <vector>
+#include <list>
 #include <set>
 #include <map>
 #include <queue>
@@ -31,8 +32,32 @@ namespace klee {
   class ExecutionState;
   class Executor;
 
+  /// States in a vector with their positions, O(1) insertion and removal
+  /// for the searchers that do not care about the order.
+  class IndexedStates {
+    std::vector<ExecutionState*> states;
+    std::unordered_map<ExecutionState*, unsigned int> positions;
+
+  public:
+    void insert(ExecutionState *es);
+    /// Returns false if \param es is not held.
+    bool remove(ExecutionState *es);
+    bool empty() const { return states.empty(); }
+    unsigned int size() const { return states.size(); }
+    ExecutionState *operator[](unsigned int i) const { return states[i]; }
+  };
+
   class Searcher {
+  protected:
+    /// held states that are not recovery states, suspended states are never
+    /// given to a searcher
+    unsigned int numOffloadable;
+
+    void countAdded(ExecutionState *es);
+    void countRemoved(ExecutionState *es);
+
   public:
+    Searcher() : numOffloadable(0) {}
     virtual ~Searcher();
 
     virtual ExecutionState &selectState() = 0;
@@ -48,6 +73,25 @@ namespace klee {
 
     virtual unsigned int getSize() = 0;
 
+    /// Number of the held states that could be given to another worker.
+    virtual unsigned int getNumOffloadable() { return numOffloadable; }
+
+    /// Appends up to \param k states that could be given to another worker
+    /// to \param out, the best candidates first.
+    virtual void getOffloadCandidates(unsigned int k,
+                                      std::vector<ExecutionState*> &out) = 0;
+
+    /// Percentage of the selections given to the recovery states, for the
+    /// searchers that keep them apart from the normal ones.
+    virtual void setRecoveryRatio(unsigned int ratio) {}
+
+    /// Lets the recovery priorities follow -adaptive-recovery-split.
+    virtual void enableAdaptiveSplit() {}
+
+    /// Called after instructions covered by other ranks were counted as
+    /// covered, for the searchers whose weights depend on the coverage.
+    virtual void coverageChanged() {}
+
     // prints name of searcher as a klee_message()
     // TODO: could probably make prettier or more flexible
     virtual void printName(llvm::raw_ostream &os) {
@@ -94,49 +138,57 @@ namespace klee {
   };
 
   class DFSSearcher : public Searcher {
-    std::vector<ExecutionState*> states;
+    /// oldest first, the back is explored next
+    std::list<ExecutionState*> states;
+    std::unordered_map<ExecutionState*, std::list<ExecutionState*>::iterator> handles;
 
     public:
     ExecutionState &selectState();
     ExecutionState* getState2Offload();
-    bool atleast2states() { return (states.size()>1?true:false); }
+    bool atleast2states() { return handles.size() > 1; }
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
-    bool empty() { return states.empty(); }
-    unsigned int getSize() { return states.size(); }
+    /// The oldest states, they root the largest unexplored subtrees.
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out);
+    bool empty() { return handles.empty(); }
+    unsigned int getSize() { return handles.size(); }
     void printName(llvm::raw_ostream &os) {
       os << "DFSSearcher\n";
     }
   };
 
   class BFSSearcher : public Searcher {
-    std::deque<ExecutionState*> states;
-    std::unordered_map<ExecutionState*,int> depthMap;
-    std::unordered_map<unsigned int, std::deque<ExecutionState*>> depthStatesMap;
-    unsigned int currentMinDepth;
+    typedef std::list<ExecutionState*> Bucket;
+
+    /// states of each depth in arrival order, the first bucket is the
+    /// minimum depth
+    std::map<unsigned int, Bucket> buckets;
+
+    /// per-state handle: the bucket depth and the position in it
+    std::unordered_map<ExecutionState*, std::pair<unsigned int, Bucket::iterator> > handles;
+
+    void insertState(ExecutionState *es);
+    void removeState(ExecutionState *es);
 
   public:
-    BFSSearcher();
-    ~BFSSearcher();
     ExecutionState &selectState();
     ExecutionState* getState2Offload();
-    bool atleast2states() { return ((depthStatesMap[currentMinDepth]).size()>1?true:false);}
+    bool atleast2states() { return !buckets.empty() && buckets.begin()->second.size() > 1; }
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
-    void insertIntoDepthStateMap(ExecutionState * current);
-    void removeFromDepthStateMap(ExecutionState* current);
-    void updateDepthStateMap(ExecutionState* current, int oldDepth);
-    bool empty() { return states.empty(); }
-    unsigned int getSize() { return states.size(); }
+    /// The shallowest states, oldest first within a depth.
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out);
+    bool empty() { return handles.empty(); }
+    unsigned int getSize() { return handles.size(); }
     void printName(llvm::raw_ostream &os) {
       os << "BFSSearcher\n";
     }
   };
 
   class RandomSearcher : public Searcher {
-    std::vector<ExecutionState*> states;
+    IndexedStates states;
 
   public:
     ExecutionState &selectState();
@@ -145,6 +197,7 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out);
     bool empty() { return states.empty(); }
     unsigned int getSize() { return states.size(); }
     void printName(llvm::raw_ostream &os) {
@@ -165,6 +218,8 @@ namespace klee {
 
   private:
     DiscretePDF<ExecutionState*> *states;
+    /// the same states, the PDF can not be walked
+    IndexedStates members;
     WeightType type;
     bool updateWeights;
     
@@ -180,8 +235,10 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out);
+    void coverageChanged();
     bool empty();
-    unsigned int getSize() {return 0; }
+    unsigned int getSize() { return members.size(); }
     void printName(llvm::raw_ostream &os) {
       os << "WeightedRandomSearcher::";
       switch(type) {
@@ -198,6 +255,9 @@ namespace klee {
 
   class RandomPathSearcher : public Searcher {
     Executor &executor;
+    /// the leaves of the process tree given to us, only counted and used
+    /// for offloading
+    IndexedStates states;
 
   public:
     RandomPathSearcher(Executor &_executor);
@@ -209,8 +269,9 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out);
     bool empty();
-    unsigned int getSize() {return 0; }
+    unsigned int getSize() { return states.size(); }
     void printName(llvm::raw_ostream &os) {
       os << "RandomPathSearcher\n";
     }
@@ -236,7 +297,14 @@ namespace klee {
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
     bool empty() { return baseSearcher->empty() && statesAtMerge.empty(); }
-    unsigned int getSize() {return 0; }
+    unsigned int getSize() { return baseSearcher->getSize() + statesAtMerge.size(); }
+    unsigned int getNumOffloadable() { return baseSearcher->getNumOffloadable(); }
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+      baseSearcher->getOffloadCandidates(k, out);
+    }
+    void setRecoveryRatio(unsigned int ratio) { baseSearcher->setRecoveryRatio(ratio); }
+    void enableAdaptiveSplit() { baseSearcher->enableAdaptiveSplit(); }
+    void coverageChanged() { baseSearcher->coverageChanged(); }
     void printName(llvm::raw_ostream &os) {
       os << "MergingSearcher\n";
     }
@@ -262,7 +330,14 @@ namespace klee {
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
     bool empty() { return baseSearcher->empty() && statesAtMerge.empty(); }
-    unsigned int getSize() {return 0; }
+    unsigned int getSize() { return baseSearcher->getSize() + statesAtMerge.size(); }
+    unsigned int getNumOffloadable() { return baseSearcher->getNumOffloadable(); }
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+      baseSearcher->getOffloadCandidates(k, out);
+    }
+    void setRecoveryRatio(unsigned int ratio) { baseSearcher->setRecoveryRatio(ratio); }
+    void enableAdaptiveSplit() { baseSearcher->enableAdaptiveSplit(); }
+    void coverageChanged() { baseSearcher->coverageChanged(); }
     void printName(llvm::raw_ostream &os) {
       os << "BumpMergingSearcher\n";
     }
@@ -285,12 +360,19 @@ namespace klee {
 
     ExecutionState &selectState();
     ExecutionState* getState2Offload();
-    bool atleast2states() { return false; }
+    bool atleast2states() { return baseSearcher->atleast2states(); }
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
     bool empty() { return baseSearcher->empty(); }
-    unsigned int getSize() {return 0; }
+    unsigned int getSize() { return baseSearcher->getSize(); }
+    unsigned int getNumOffloadable() { return baseSearcher->getNumOffloadable(); }
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+      baseSearcher->getOffloadCandidates(k, out);
+    }
+    void setRecoveryRatio(unsigned int ratio) { baseSearcher->setRecoveryRatio(ratio); }
+    void enableAdaptiveSplit() { baseSearcher->enableAdaptiveSplit(); }
+    void coverageChanged() { baseSearcher->coverageChanged(); }
     void printName(llvm::raw_ostream &os) {
       os << "<BatchingSearcher> timeBudget: " << timeBudget
          << ", instructionBudget: " << instructionBudget
@@ -316,7 +398,17 @@ namespace klee {
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
     bool empty() { return baseSearcher->empty() && pausedStates.empty(); }
-    unsigned int getSize() { return 0; }
+    unsigned int getSize() { return baseSearcher->getSize() + pausedStates.size(); }
+    /// numOffloadable counts the paused states
+    unsigned int getNumOffloadable() {
+      return baseSearcher->getNumOffloadable() + numOffloadable;
+    }
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+      baseSearcher->getOffloadCandidates(k, out);
+    }
+    void setRecoveryRatio(unsigned int ratio) { baseSearcher->setRecoveryRatio(ratio); }
+    void enableAdaptiveSplit() { baseSearcher->enableAdaptiveSplit(); }
+    void coverageChanged() { baseSearcher->coverageChanged(); }
     void printName(llvm::raw_ostream &os) {
       os << "IterativeDeepeningTimeSearcher\n";
     }
@@ -339,7 +431,27 @@ namespace klee {
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
     bool empty() { return searchers[0]->empty(); }
-    unsigned int getSize() { return 0; }
+    /// every searcher holds all the states
+    unsigned int getSize() { return searchers[0]->getSize(); }
+    unsigned int getNumOffloadable() { return searchers[0]->getNumOffloadable(); }
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+      searchers[0]->getOffloadCandidates(k, out);
+    }
+    void setRecoveryRatio(unsigned int ratio) {
+      for (searchers_ty::iterator it = searchers.begin(), ie = searchers.end();
+           it != ie; ++it)
+        (*it)->setRecoveryRatio(ratio);
+    }
+    void enableAdaptiveSplit() {
+      for (searchers_ty::iterator it = searchers.begin(), ie = searchers.end();
+           it != ie; ++it)
+        (*it)->enableAdaptiveSplit();
+    }
+    void coverageChanged() {
+      for (searchers_ty::iterator it = searchers.begin(), ie = searchers.end();
+           it != ie; ++it)
+        (*it)->coverageChanged();
+    }
     
     void printName(llvm::raw_ostream &os) {
       os << "<InterleavedSearcher> containing "
@@ -368,6 +480,12 @@ namespace klee {
                 const std::vector<ExecutionState *> &removedStates);
     bool empty();
     unsigned int getSize() { return (baseSearcher->getSize() + recoverySearcher->getSize()); } 
+    unsigned int getNumOffloadable() { return baseSearcher->getNumOffloadable(); }
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+      baseSearcher->getOffloadCandidates(k, out);
+    }
+    void setRecoveryRatio(unsigned int ratio) { this->ratio = ratio; }
+    void coverageChanged() { baseSearcher->coverageChanged(); }
     void printName(llvm::raw_ostream &os) {
       os << "SplittedSearcher\n";
       os << "- base searcher: "; baseSearcher->printName(os);
@@ -383,7 +501,7 @@ namespace klee {
      */
     std::stack<PTree::Node *> treeStack;
     /* this is a simple way to keep track of the states of the recovery trees */
-    std::vector<ExecutionState *> states;
+    IndexedStates states;
 
   public:
     RandomRecoveryPath(Executor &executor);
@@ -398,7 +516,9 @@ namespace klee {
                 const std::vector<ExecutionState *> &removedStates);
 
     bool empty();
-    unsigned int getSize() { return 0; }
+    unsigned int getSize() { return states.size(); }
+    /// recovery states are never offloaded
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {}
 
     void printName(llvm::raw_ostream &os) {
       os << "RandomRecoveryPath\n";
@@ -411,6 +531,8 @@ namespace klee {
     Searcher *recoverySearcher;
     Searcher *highPrioritySearcher;
     unsigned int ratio;
+    /// roots may start at low priority, see enableAdaptiveSplit
+    bool adaptiveSplit;
 
   public:
     OptimizedSplittedSearcher(
@@ -423,13 +545,23 @@ namespace klee {
 
     ExecutionState &selectState();
     ExecutionState* getState2Offload();
-    bool atleast2states() { return false; }
+    bool atleast2states() { return baseSearcher->atleast2states(); }
 
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
     bool empty();
-    unsigned int getSize() { return 0; }
+    unsigned int getSize() {
+      return baseSearcher->getSize() + recoverySearcher->getSize() +
+             highPrioritySearcher->getSize();
+    }
+    unsigned int getNumOffloadable() { return baseSearcher->getNumOffloadable(); }
+    void getOffloadCandidates(unsigned int k, std::vector<ExecutionState*> &out) {
+      baseSearcher->getOffloadCandidates(k, out);
+    }
+    void setRecoveryRatio(unsigned int ratio) { this->ratio = ratio; }
+    void enableAdaptiveSplit() { adaptiveSplit = true; }
+    void coverageChanged() { baseSearcher->coverageChanged(); }
     void printName(llvm::raw_ostream &os) {
       os << "OptimizedSplittedSearcher\n";
       os << "- base searcher: "; baseSearcher->printName(os);
@@ -0,0 +1,270 @@
+//===-- SharedQueryCache.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SharedQueryCache.h"
+
+#include "klee/Constraints.h"
+#include "klee/Statistic.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+using namespace llvm;
+using namespace klee;
+
+//MPI_Test rounds before a remote lookup counts as a miss
+#define REMOTE_LOOKUP_POLLS 64
+
+//entries kept by the local tier
+#define HOT_TIER_LIMIT (1 << 20)
+
+namespace {
+  cl::opt<unsigned>
+  SharedQueryCacheSlots("shared-query-cache",
+                        cl::desc("Slots each worker contributes to the validity cache "
+                                 "shared by all ranks over MPI RMA (default=0 (off))"),
+                        cl::init(0));
+
+  inline uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    return h ^ (h >> 27);
+  }
+
+  //an independent second hash, so a collision has to hit both
+  inline uint64_t mix2(uint64_t h, uint64_t v) {
+    h = (h ^ v) * 0x100000001b3ULL + 0x6a09e667f3bcc909ULL;
+    h ^= h >> 29;
+    h *= 0x94d049bb133111ebULL;
+    return h ^ (h >> 32);
+  }
+
+  inline SharedQueryCache::Fingerprint mix(SharedQueryCache::Fingerprint fp,
+                                           uint64_t v) {
+    fp.key = mix(fp.key, v);
+    fp.check = mix2(fp.check, v);
+    return fp;
+  }
+
+  inline SharedQueryCache::Fingerprint mix(SharedQueryCache::Fingerprint fp,
+                                           const SharedQueryCache::Fingerprint &v) {
+    fp.key = mix(fp.key, v.key);
+    fp.check = mix2(fp.check, v.check);
+    return fp;
+  }
+
+  //True, False and Unknown as the two low bits of an entry, 0 is empty
+  uint8_t encodeValidity(Solver::Validity v) {
+    return v == Solver::True ? 1 : (v == Solver::False ? 2 : 3);
+  }
+
+  Solver::Validity decodeValidity(uint8_t code) {
+    return code == 1 ? Solver::True : (code == 2 ? Solver::False : Solver::Unknown);
+  }
+}
+
+namespace klee {
+  SharedQueryCache *theSharedQueryCache = 0;
+
+  namespace stats {
+    Statistic sharedCacheLocalHits("SharedCacheLocalHits", "SCLocal");
+    Statistic sharedCacheRemoteHits("SharedCacheRemoteHits", "SCRemote");
+    Statistic sharedCacheMisses("SharedCacheMisses", "SCMiss");
+  }
+}
+
+//expressions hashed so far and the arrays in order of first use, for one
+//query. Array names are given per rank, their numbers are not
+struct SharedQueryCache::HashContext {
+  std::map<const Expr *, Fingerprint> exprs;
+  std::map<const Array *, unsigned> arrays;
+};
+
+SharedQueryCache::SharedQueryCache(uint64_t slotsPerWorker)
+  : win(MPI_WIN_NULL), slots(0), slotsPerOwner(slotsPerWorker),
+    firstOwner(2), numOwners(0), numPublished(0) {
+  int rank, numRanks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+  //the master and the timeout rank only read and publish
+  numOwners = std::max(0, numRanks - firstOwner);
+  MPI_Aint bytes = (rank >= firstOwner) ? slotsPerOwner * 2 * sizeof(uint64_t) : 0;
+
+  MPI_Win_allocate(bytes, sizeof(uint64_t), MPI_INFO_NULL, MPI_COMM_WORLD,
+                   &slots, &win);
+  if (bytes)
+    memset(slots, 0, bytes);
+  MPI_Barrier(MPI_COMM_WORLD);
+  //one passive epoch for the whole run, no rank ever waits on a target
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+}
+
+SharedQueryCache::~SharedQueryCache() {
+  MPI_Win_flush_local_all(win);
+  for (std::deque<PendingGet>::iterator it = staleGets.begin(),
+         ie = staleGets.end(); it != ie; ++it)
+    MPI_Wait(&it->req, MPI_STATUS_IGNORE);
+  MPI_Win_unlock_all(win);
+  MPI_Win_free(&win);
+}
+
+void SharedQueryCache::initialize() {
+  if (SharedQueryCacheSlots)
+    theSharedQueryCache = new SharedQueryCache(SharedQueryCacheSlots);
+}
+
+void SharedQueryCache::finalize() {
+  delete theSharedQueryCache;
+  theSharedQueryCache = 0;
+}
+
+SharedQueryCache::Fingerprint
+SharedQueryCache::hashExpr(const ref<Expr> &e, HashContext &ctx) {
+  std::map<const Expr *, Fingerprint>::iterator it = ctx.exprs.find(e.get());
+  if (it != ctx.exprs.end())
+    return it->second;
+
+  //Expr::hash() is only 32 bits, too weak to trust an answer across ranks
+  Fingerprint h = { (uint64_t) e->getKind(), (uint64_t) e->getKind() };
+  h = mix(h, e->getWidth());
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+    h = mix(h, ce->getWidth() <= 64 ? ce->getZExtValue() : ce->hash());
+  } else if (ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    const Array *root = re->updates.root;
+    std::map<const Array *, unsigned>::iterator ait = ctx.arrays.find(root);
+    if (ait == ctx.arrays.end()) {
+      unsigned number = ctx.arrays.size();
+      ait = ctx.arrays.insert(std::make_pair(root, number)).first;
+    }
+    h = mix(h, ait->second);
+    h = mix(h, root->size);
+    h = mix(h, root->getDomain());
+    h = mix(h, root->getRange());
+    h = mix(h, root->constantValues.size());
+    for (unsigned i = 0; i < root->constantValues.size(); ++i)
+      h = mix(h, hashExpr(root->constantValues[i], ctx));
+    for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+      h = mix(h, hashExpr(un->index, ctx));
+      h = mix(h, hashExpr(un->value, ctx));
+    }
+    h = mix(h, hashExpr(re->index, ctx));
+  } else {
+    if (ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+      h = mix(h, ee->offset);
+    h = mix(h, e->getNumKids());
+    for (unsigned i = 0; i < e->getNumKids(); ++i)
+      h = mix(h, hashExpr(e->getKid(i), ctx));
+  }
+
+  ctx.exprs.insert(std::make_pair(e.get(), h));
+  return h;
+}
+
+SharedQueryCache::Fingerprint
+SharedQueryCache::hashQuery(const ConstraintManager &constraints,
+                            ref<Expr> query) {
+  //the path order, which the array numbers follow
+  HashContext ctx;
+  Fingerprint h = { 0, 0 };
+  h = mix(h, constraints.size());
+  for (ConstraintManager::const_iterator it = constraints.begin(),
+         ie = constraints.end(); it != ie; ++it)
+    h = mix(h, hashExpr(*it, ctx));
+  return mix(h, hashExpr(query, ctx));
+}
+
+void SharedQueryCache::locate(uint64_t key, int &owner, MPI_Aint &slot) const {
+  owner = firstOwner + (key % numOwners);
+  slot = 2 * ((key / numOwners) % slotsPerOwner);
+}
+
+void SharedQueryCache::reapStaleGets() {
+  while (!staleGets.empty()) {
+    int done;
+    MPI_Test(&staleGets.front().req, &done, MPI_STATUS_IGNORE);
+    if (!done)
+      break;
+    staleGets.pop_front();
+  }
+}
+
+bool SharedQueryCache::lookupRemote(const Fingerprint &fp, uint8_t &code) {
+  reapStaleGets();
+  int owner;
+  MPI_Aint slot;
+  locate(fp.key, owner, slot);
+
+  staleGets.push_back(PendingGet());
+  PendingGet &get = staleGets.back();
+  uint64_t unused[2] = { 0, 0 };
+  MPI_Rget_accumulate(unused, 2, MPI_UINT64_T, get.entry, 2, MPI_UINT64_T,
+                      owner, slot, 2, MPI_UINT64_T, MPI_NO_OP, win, &get.req);
+  int done = 0;
+  for (unsigned i = 0; i < REMOTE_LOOKUP_POLLS && !done; ++i)
+    MPI_Test(&get.req, &done, MPI_STATUS_IGNORE);
+  if (!done)
+    return false; //left for reapStaleGets
+
+  //the words are atomic one by one, a read racing a publish gets a
+  //mismatch on one of them
+  uint64_t check = get.entry[0], entry = get.entry[1];
+  staleGets.pop_back();
+  if (!entry || check != fp.check || (entry & ~3ULL) != (fp.key & ~3ULL))
+    return false;
+  code = entry & 3;
+  return true;
+}
+
+bool SharedQueryCache::lookup(const Fingerprint &fp, Solver::Validity &result) {
+  std::unordered_map<uint64_t, std::pair<uint64_t, uint8_t> >::iterator it =
+    hotTier.find(fp.key);
+  if (it != hotTier.end() && it->second.first == fp.check) {
+    ++stats::sharedCacheLocalHits;
+    result = decodeValidity(it->second.second);
+    return true;
+  }
+  uint8_t code;
+  if (numOwners && lookupRemote(fp, code)) {
+    ++stats::sharedCacheRemoteHits;
+    if (hotTier.size() < HOT_TIER_LIMIT)
+      hotTier[fp.key] = std::make_pair(fp.check, code);
+    result = decodeValidity(code);
+    return true;
+  }
+  ++stats::sharedCacheMisses;
+  return false;
+}
+
+void SharedQueryCache::insert(const Fingerprint &fp, Solver::Validity result) {
+  uint8_t code = encodeValidity(result);
+  if (hotTier.size() >= HOT_TIER_LIMIT)
+    hotTier.clear();
+  hotTier[fp.key] = std::make_pair(fp.check, code);
+  if (!numOwners)
+    return;
+
+  //the origin words must stay untouched until the puts complete locally
+  if (2 * numPublished == sizeof(publishBuf) / sizeof(publishBuf[0])) {
+    MPI_Win_flush_local_all(win);
+    numPublished = 0;
+  }
+  int owner;
+  MPI_Aint slot;
+  locate(fp.key, owner, slot);
+  uint64_t *entry = &publishBuf[2 * numPublished++];
+  entry[0] = fp.check;
+  entry[1] = (fp.key & ~3ULL) | code;
+  MPI_Accumulate(entry, 2, MPI_UINT64_T, owner, slot, 2, MPI_UINT64_T,
+                 MPI_REPLACE, win);
+}
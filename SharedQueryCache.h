@@ -0,0 +1,94 @@
+//===-- SharedQueryCache.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Validity cache for branch queries shared by all ranks. A local hot tier
+// sits in front of a hash table spread over the workers' RMA windows. A
+// query is identified by two independent 64-bit hashes, both are checked
+// on a hit, and each slot holds them in two words read and written with
+// atomic accumulates.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SHAREDQUERYCACHE_H
+#define KLEE_SHAREDQUERYCACHE_H
+
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+
+#include <deque>
+#include <unordered_map>
+#include <stdint.h>
+#include <mpi.h>
+
+namespace klee {
+  class ConstraintManager;
+
+class SharedQueryCache {
+public:
+  /// \param key places the query, \param check confirms a hit
+  struct Fingerprint {
+    uint64_t key;
+    uint64_t check;
+  };
+
+private:
+  struct PendingGet {
+    MPI_Request req;
+    uint64_t entry[2];
+  };
+
+  struct HashContext;
+
+  MPI_Win win;
+  uint64_t *slots;
+  uint64_t slotsPerOwner;
+  int firstOwner, numOwners;
+
+  /// check and validity code by key
+  std::unordered_map<uint64_t, std::pair<uint64_t, uint8_t> > hotTier;
+
+  /// remote lookups given up on, reaped before the next one
+  std::deque<PendingGet> staleGets;
+
+  /// origin buffers of the publishes not yet locally complete, two words
+  /// each
+  uint64_t publishBuf[128];
+  unsigned numPublished;
+
+  SharedQueryCache(uint64_t slotsPerWorker);
+
+  Fingerprint hashExpr(const ref<Expr> &e, HashContext &ctx);
+  void locate(uint64_t key, int &owner, MPI_Aint &slot) const;
+  bool lookupRemote(const Fingerprint &fp, uint8_t &code);
+  void reapStaleGets();
+
+public:
+  ~SharedQueryCache();
+
+  /// Canonical fingerprint of \param constraints, in path order, and
+  /// \param query. Arrays are numbered by first use, so the same query
+  /// built from differently named arrays matches.
+  Fingerprint hashQuery(const ConstraintManager &constraints, ref<Expr> query);
+
+  bool lookup(const Fingerprint &fp, Solver::Validity &result);
+
+  /// Records \param result locally and publishes it without waiting.
+  void insert(const Fingerprint &fp, Solver::Validity result);
+
+  /// Collective over MPI_COMM_WORLD, every rank has to call it right
+  /// after MPI_Init. Sets theSharedQueryCache when -shared-query-cache
+  /// is on.
+  static void initialize();
+  static void finalize();
+};
+
+  extern SharedQueryCache *theSharedQueryCache;
+}
+
+#endif
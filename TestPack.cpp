@@ -0,0 +1,140 @@
+//===-- TestPack.cpp ------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TestPack.h"
+
+using namespace klee;
+
+//tests queued before the exploration waits for the writer
+#define TEST_PACK_QUEUE_LIMIT 4096
+#define TEST_PACK_BUFFER (1 << 20)
+
+//the layout kTest_toFile writes, version 3
+#define KTEST_MAGIC "KTEST"
+#define KTEST_VERSION 3
+
+namespace {
+  void appendUInt32(std::string &out, uint32_t v) {
+    //big endian, as in the .ktest files
+    out += (char) (v >> 24);
+    out += (char) (v >> 16);
+    out += (char) (v >> 8);
+    out += (char) v;
+  }
+
+  void appendString(std::string &out, const char *data, uint32_t size) {
+    appendUInt32(out, size);
+    out.append(data, size);
+  }
+}
+
+TestPackWriter::TestPackWriter(const std::string &path, int argc, char **argv)
+  : pack(fopen(path.c_str(), "wb")), index(fopen((path + ".idx").c_str(), "wb")),
+    offset(0), args(argv, argv + argc), closing(false) {
+  if (pack)
+    setvbuf(pack, NULL, _IOFBF, TEST_PACK_BUFFER);
+  writer = std::thread(&TestPackWriter::run, this);
+}
+
+TestPackWriter::~TestPackWriter() {
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    closing = true;
+  }
+  ready.notify_one();
+  writer.join();
+  if (pack)
+    fclose(pack);
+  if (index)
+    fclose(index);
+}
+
+void TestPackWriter::add(unsigned id, const std::string &suffix,
+                         const std::string &data) {
+  std::unique_lock<std::mutex> guard(lock);
+  while (jobs.size() >= TEST_PACK_QUEUE_LIMIT)
+    space.wait(guard);
+  jobs.push_back(Job());
+  Job &job = jobs.back();
+  job.id = id;
+  job.suffix = suffix;
+  job.data = data;
+  job.isKTest = false;
+  guard.unlock();
+  ready.notify_one();
+}
+
+void TestPackWriter::addKTest(unsigned id, Solution &objects) {
+  std::unique_lock<std::mutex> guard(lock);
+  while (jobs.size() >= TEST_PACK_QUEUE_LIMIT)
+    space.wait(guard);
+  jobs.push_back(Job());
+  Job &job = jobs.back();
+  job.id = id;
+  job.suffix = "ktest";
+  job.objects.swap(objects);
+  job.isKTest = true;
+  guard.unlock();
+  ready.notify_one();
+}
+
+void TestPackWriter::run() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    while (jobs.empty() && !closing)
+      ready.wait(guard);
+    if (jobs.empty())
+      return;
+    Job job;
+    std::swap(job, jobs.front());
+    jobs.pop_front();
+    guard.unlock();
+    space.notify_one();
+    write(job);
+    guard.lock();
+  }
+}
+
+void TestPackWriter::write(const Job &job) {
+  if (!good())
+    return;
+  std::string encoded;
+  if (job.isKTest)
+    encodeKTest(job.objects, encoded);
+  const std::string &data = job.isKTest ? encoded : job.data;
+
+  uint32_t head[2] = { job.id, (uint32_t) job.suffix.size() };
+  uint64_t size = data.size();
+  uint32_t entryId[2] = { job.id, 0 };
+  fwrite(head, sizeof(head), 1, pack);
+  fwrite(&size, sizeof(size), 1, pack);
+  fwrite(job.suffix.data(), 1, job.suffix.size(), pack);
+  fwrite(data.data(), 1, data.size(), pack);
+  fwrite(entryId, sizeof(entryId), 1, index);
+  fwrite(&offset, sizeof(offset), 1, index);
+  offset += sizeof(head) + sizeof(size) + job.suffix.size() + data.size();
+}
+
+void TestPackWriter::encodeKTest(const Solution &objects,
+                                 std::string &out) const {
+  out.append(KTEST_MAGIC, 5);
+  appendUInt32(out, KTEST_VERSION);
+  appendUInt32(out, args.size());
+  for (unsigned i = 0; i < args.size(); ++i)
+    appendString(out, args[i].data(), args[i].size());
+  //symArgvs and symArgvLen
+  appendUInt32(out, 0);
+  appendUInt32(out, 0);
+  appendUInt32(out, objects.size());
+  for (unsigned i = 0; i < objects.size(); ++i) {
+    appendString(out, objects[i].first.data(), objects[i].first.size());
+    appendString(out, (const char *) objects[i].second.data(),
+                 objects[i].second.size());
+  }
+}
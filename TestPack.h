@@ -0,0 +1,82 @@
+//===-- TestPack.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Test case files of a rank appended to one pack file by a background
+// thread, so exploration does not wait on the file system. A record is
+//
+//   uint32 id, uint32 suffix length, uint64 data length, suffix, data
+//
+// and the data is what test<id>.<suffix> would have held, .ktest files
+// included. <pack>.idx holds one (uint32 id, uint32 0, uint64 offset)
+// entry per record. klee-unpack-tests turns a pack back into files.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_TESTPACK_H
+#define KLEE_TESTPACK_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace klee {
+
+class TestPackWriter {
+public:
+  typedef std::vector< std::pair<std::string, std::vector<unsigned char> > >
+    Solution;
+
+private:
+  struct Job {
+    unsigned id;
+    std::string suffix;
+    /// the file contents, or the objects of a .ktest to encode
+    std::string data;
+    Solution objects;
+    bool isKTest;
+  };
+
+  FILE *pack, *index;
+  uint64_t offset;
+
+  /// recorded in every .ktest
+  std::vector<std::string> args;
+
+  std::deque<Job> jobs;
+  std::mutex lock;
+  std::condition_variable ready, space;
+  bool closing;
+  std::thread writer;
+
+  void run();
+  void write(const Job &job);
+  void encodeKTest(const Solution &objects, std::string &out) const;
+
+public:
+  TestPackWriter(const std::string &path, int argc, char **argv);
+  /// Writes what is still queued.
+  ~TestPackWriter();
+
+  bool good() const { return pack && index; }
+
+  /// Queues the file \param suffix of test \param id.
+  void add(unsigned id, const std::string &suffix, const std::string &data);
+  /// Queues the .ktest of test \param id, encoded by the writer thread.
+  void addKTest(unsigned id, Solution &objects);
+};
+
+}
+
+#endif
@@ -0,0 +1,148 @@
+//===-- TestPackTest.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Reads back a pack written by TestPackWriter: the records, the index
+// offsets and the .ktest layout kTest_fromFile expects. Standalone, exits
+// non-zero on the first failure:
+//
+//   c++ -std=c++14 -pthread TestPackTest.cpp TestPack.cpp && ./a.out
+//
+//===----------------------------------------------------------------------===//
+
+#undef NDEBUG
+#include "TestPack.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+  struct Record {
+    uint32_t id;
+    std::string suffix, data;
+  };
+
+  //the layout klee-unpack-tests reads
+  bool readRecord(FILE *pack, Record &record) {
+    uint32_t head[2];
+    uint64_t size;
+    if (fread(head, sizeof(head), 1, pack) != 1 ||
+        fread(&size, sizeof(size), 1, pack) != 1)
+      return false;
+    record.id = head[0];
+    record.suffix.resize(head[1]);
+    record.data.resize(size);
+    return (!head[1] || fread(&record.suffix[0], 1, head[1], pack) == head[1]) &&
+           (!size || fread(&record.data[0], 1, size, pack) == size);
+  }
+
+  //big endian, as kTest_fromFile reads them
+  uint32_t getUInt32(const std::string &in, size_t &pos) {
+    assert(pos + 4 <= in.size());
+    const unsigned char *p = (const unsigned char *) in.data() + pos;
+    pos += 4;
+    return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+  }
+
+  std::string getString(const std::string &in, size_t &pos) {
+    uint32_t size = getUInt32(in, pos);
+    assert(pos + size <= in.size());
+    pos += size;
+    return in.substr(pos - size, size);
+  }
+}
+
+int main() {
+  char path[] = "/tmp/testpack-test-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  std::string indexPath = std::string(path) + ".idx";
+
+  const char *argv[] = { "klee", "--libc=uclibc", "prog.bc" };
+  TestPackWriter::Solution objects;
+  objects.push_back(std::make_pair(std::string("arg0"),
+                                   std::vector<unsigned char>(3, 'a')));
+  objects.push_back(std::make_pair(std::string("empty"),
+                                   std::vector<unsigned char>()));
+  unsigned char bytes[] = { 0, 0xff, 0x80, 7 };
+  objects.push_back(std::make_pair(std::string("model"),
+                                   std::vector<unsigned char>(bytes, bytes + 4)));
+  TestPackWriter::Solution expected = objects;
+  std::string binary("\0\1\2", 3);
+  {
+    TestPackWriter writer(path, 3, (char **) argv);
+    assert(writer.good());
+    writer.add(1, "err", "memory error\n");
+    writer.addKTest(1, objects);
+    writer.add(2, "bin", binary);
+    writer.add(3, "", "");
+  }
+
+  FILE *pack = fopen(path, "rb");
+  FILE *index = fopen(indexPath.c_str(), "rb");
+  assert(pack && index);
+  std::vector<Record> records;
+  std::vector<uint64_t> offsets;
+  while (true) {
+    uint32_t entryId[2];
+    uint64_t offset;
+    if (fread(entryId, sizeof(entryId), 1, index) != 1)
+      break;
+    assert(fread(&offset, sizeof(offset), 1, index) == 1);
+    assert(offset == (uint64_t) ftell(pack));
+    Record record;
+    assert(readRecord(pack, record));
+    assert(entryId[0] == record.id && entryId[1] == 0);
+    records.push_back(record);
+  }
+  Record extra;
+  assert(!readRecord(pack, extra));
+  fclose(pack);
+  fclose(index);
+
+  //in the order they were queued
+  assert(records.size() == 4);
+  assert(records[0].id == 1 && records[0].suffix == "err" &&
+         records[0].data == "memory error\n");
+  assert(records[1].id == 1 && records[1].suffix == "ktest");
+  assert(records[2].id == 2 && records[2].suffix == "bin" &&
+         records[2].data == binary);
+  assert(records[3].id == 3 && records[3].suffix.empty() &&
+         records[3].data.empty());
+
+  const std::string &ktest = records[1].data;
+  size_t pos = 5;
+  assert(ktest.compare(0, 5, "KTEST") == 0);
+  assert(getUInt32(ktest, pos) == 3);
+  assert(getUInt32(ktest, pos) == 3);
+  for (unsigned i = 0; i < 3; ++i)
+    assert(getString(ktest, pos) == argv[i]);
+  //symArgvs and symArgvLen
+  assert(getUInt32(ktest, pos) == 0);
+  assert(getUInt32(ktest, pos) == 0);
+  assert(getUInt32(ktest, pos) == expected.size());
+  for (unsigned i = 0; i < expected.size(); ++i) {
+    assert(getString(ktest, pos) == expected[i].first);
+    std::string data = getString(ktest, pos);
+    assert(data == std::string(expected[i].second.begin(),
+                               expected[i].second.end()));
+  }
+  assert(pos == ktest.size());
+
+  unlink(path);
+  unlink(indexPath.c_str());
+  printf("TestPackTest: ok\n");
+  return 0;
+}
@@ -0,0 +1,106 @@
+//===-- TestUnpack.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// klee-unpack-tests: writes the test files kept in a -test-pack file back
+// as test<id>.<suffix>, all of them or only those of the ids given.
+//
+//   klee-unpack-tests <output dir>/tests.pack <dir> [id...]
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace {
+  //reads the record at the current position, false at the end
+  bool readRecord(FILE *pack, uint32_t &id, std::string &suffix,
+                  std::vector<char> &data) {
+    uint32_t head[2];
+    uint64_t size;
+    if (fread(head, sizeof(head), 1, pack) != 1 ||
+        fread(&size, sizeof(size), 1, pack) != 1)
+      return false;
+    id = head[0];
+    suffix.resize(head[1]);
+    data.resize(size);
+    return (!head[1] || fread(&suffix[0], 1, head[1], pack) == head[1]) &&
+           (!size || fread(&data[0], 1, size, pack) == size);
+  }
+
+  bool writeFile(const std::string &dir, uint32_t id, const std::string &suffix,
+                 const std::vector<char> &data) {
+    char name[32];
+    snprintf(name, sizeof(name), "test%06u.", id);
+    std::string path = dir + "/" + name + suffix;
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+      return false;
+    bool ok = data.empty() || fwrite(&data[0], 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <pack> <dir> [id...]\n", argv[0]);
+    return 1;
+  }
+  FILE *pack = fopen(argv[1], "rb");
+  if (!pack) {
+    fprintf(stderr, "%s: cannot open\n", argv[1]);
+    return 1;
+  }
+
+  std::set<uint32_t> wanted;
+  for (int i = 3; i < argc; ++i)
+    wanted.insert(strtoul(argv[i], NULL, 10));
+
+  //only the records of the wanted ids are read, through the index
+  std::vector<uint64_t> offsets;
+  if (!wanted.empty()) {
+    std::string indexPath = std::string(argv[1]) + ".idx";
+    FILE *index = fopen(indexPath.c_str(), "rb");
+    if (!index) {
+      fprintf(stderr, "%s: cannot open\n", indexPath.c_str());
+      return 1;
+    }
+    uint32_t entryId[2];
+    uint64_t offset;
+    while (fread(entryId, sizeof(entryId), 1, index) == 1 &&
+           fread(&offset, sizeof(offset), 1, index) == 1) {
+      if (wanted.count(entryId[0]))
+        offsets.push_back(offset);
+    }
+    fclose(index);
+  }
+
+  uint32_t id;
+  std::string suffix;
+  std::vector<char> data;
+  unsigned written = 0;
+  for (unsigned i = 0; wanted.empty() || i < offsets.size(); ++i) {
+    if (!wanted.empty() && fseeko(pack, offsets[i], SEEK_SET) != 0)
+      break;
+    if (!readRecord(pack, id, suffix, data))
+      break;
+    if (!writeFile(argv[2], id, suffix, data)) {
+      fprintf(stderr, "%s: cannot write test%06u.%s\n", argv[2], id,
+              suffix.c_str());
+      return 1;
+    }
+    ++written;
+  }
+  fclose(pack);
+  printf("%u files written\n", written);
+  return 0;
+}
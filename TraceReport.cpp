@@ -0,0 +1,315 @@
+//===-- TraceReport.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// klee-trace-report: merges the -event-trace files of a run and prints the
+// per-rank summary, a utilization timeline and the chain of tasks that
+// ended last.
+//
+//   klee-trace-report [-csv] trace.0 trace.2 trace.3 ...
+//
+// With -csv it prints one machine-readable row per rank plus a row for the
+// whole run instead, a benchmark sweep over rank counts, depths, searchers
+// and -lb collects these rows and derives speedup and efficiency from the
+// wall times.
+//
+//===----------------------------------------------------------------------===//
+
+#include "EventTrace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace klee;
+
+//columns of the utilization timeline
+#define TIMELINE_BUCKETS 40
+
+namespace {
+  struct RankTrace {
+    EventTrace::Header header;
+    std::vector<EventTrace::Event> events;
+  };
+
+  struct Task {
+    int rank;
+    uint64_t start, finish;
+  };
+
+  bool readTrace(const char *path, RankTrace &trace) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+      return false;
+    bool ok = fread(&trace.header, sizeof(trace.header), 1, f) == 1 &&
+              !memcmp(trace.header.magic, "KTRC", 4);
+    if (ok) {
+      trace.events.resize(trace.header.count);
+      ok = !trace.header.count ||
+           fread(&trace.events[0], sizeof(EventTrace::Event),
+                 trace.header.count, f) == trace.header.count;
+    }
+    fclose(f);
+    return ok;
+  }
+
+  double seconds(uint64_t ns) { return ns / 1e9; }
+
+  //busy periods: from the first task taken while idle to its FINISH
+  void collectTasks(const RankTrace &trace, std::vector<Task> &tasks) {
+    bool running = false;
+    Task task;
+    task.rank = trace.header.rank;
+    for (unsigned i = 0; i < trace.events.size(); ++i) {
+      const EventTrace::Event &e = trace.events[i];
+      if (e.kind == EventTrace::TaskStart && !running) {
+        task.start = e.time;
+        running = true;
+      } else if (e.kind == EventTrace::TaskFinish && running) {
+        task.finish = e.time;
+        tasks.push_back(task);
+        running = false;
+      }
+    }
+  }
+
+  struct RankSummary {
+    uint64_t idle, replay, explore, solver;
+    uint64_t offloads, refused, latency, maxLatency;
+    uint64_t recoveries, tasks, peakRSS;
+
+    RankSummary()
+      : idle(0), replay(0), explore(0), solver(0), offloads(0), refused(0),
+        latency(0), maxLatency(0), recoveries(0), tasks(0), peakRSS(0) {}
+  };
+
+  void summarize(const RankTrace &trace, RankSummary &sum) {
+    std::map<int, uint64_t> asked;
+    for (unsigned i = 0; i < trace.events.size(); ++i) {
+      const EventTrace::Event &e = trace.events[i];
+      switch (e.kind) {
+      case EventTrace::Idle: sum.idle += e.value; break;
+      case EventTrace::Instructions:
+        (e.arg ? sum.replay : sum.explore) += e.value;
+        break;
+      case EventTrace::SolverTime: sum.solver += e.value; break;
+      case EventTrace::RecoveryStart: ++sum.recoveries; break;
+      case EventTrace::TaskStart: sum.tasks += e.value; break;
+      case EventTrace::PeakRSS: sum.peakRSS = e.value; break;
+      case EventTrace::OffloadRequest: asked[e.arg] = e.time; break;
+      case EventTrace::OffloadResponse: {
+        std::map<int, uint64_t>::iterator it = asked.find(e.arg);
+        if (it != asked.end()) {
+          uint64_t l = e.time - it->second;
+          sum.latency += l;
+          sum.maxLatency = std::max(sum.maxLatency, l);
+          asked.erase(it);
+        }
+        ++(e.value ? sum.offloads : sum.refused);
+        break;
+      }
+      default: break;
+      }
+    }
+  }
+
+  double busyShare(const RankSummary &sum, uint64_t span) {
+    return span ? (double) (span - std::min(span, sum.idle)) / span : 0.0;
+  }
+
+  void printRank(const RankTrace &trace, uint64_t span) {
+    RankSummary sum;
+    summarize(trace, sum);
+    uint64_t answered = sum.offloads + sum.refused;
+    printf("rank %d: busy %.1f%% tasks %llu idle %.3fs solver %.3fs peak rss %llu KB\n",
+           trace.header.rank, 100 * busyShare(sum, span),
+           (unsigned long long) sum.tasks, seconds(sum.idle), seconds(sum.solver),
+           (unsigned long long) sum.peakRSS);
+    printf("  instructions: replay %llu explore %llu (%.1f%% replay)\n",
+           (unsigned long long) sum.replay, (unsigned long long) sum.explore,
+           sum.replay + sum.explore ?
+             100.0 * sum.replay / (sum.replay + sum.explore) : 0.0);
+    printf("  offloads: given %llu refused %llu latency avg %.3fms max %.3fms\n",
+           (unsigned long long) sum.offloads, (unsigned long long) sum.refused,
+           answered ? seconds(sum.latency) * 1e3 / answered : 0.0,
+           seconds(sum.maxLatency) * 1e3);
+    printf("  recoveries: %llu\n", (unsigned long long) sum.recoveries);
+    if (trace.header.dropped)
+      printf("  warning: %llu oldest events were overwritten\n",
+             (unsigned long long) trace.header.dropped);
+  }
+
+  //one row per rank and a last one for the run (rank -1), the columns are
+  //what a sweep compares across commits
+  void printCSV(const std::vector<RankTrace> &traces, uint64_t span) {
+    printf("rank,wall_s,busy_share,idle_s,tasks,offloads,refused,"
+           "replay_instructions,explore_instructions,solver_s,recoveries,"
+           "peak_rss_kb,dropped_events\n");
+    RankSummary total;
+    uint64_t dropped = 0;
+    double busy = 0;
+    unsigned workers = 0;
+    for (unsigned r = 0; r < traces.size(); ++r) {
+      RankSummary sum;
+      summarize(traces[r], sum);
+      printf("%d,%.6f,%.4f,%.6f,%llu,%llu,%llu,%llu,%llu,%.6f,%llu,%llu,%llu\n",
+             traces[r].header.rank, seconds(span), busyShare(sum, span),
+             seconds(sum.idle), (unsigned long long) sum.tasks,
+             (unsigned long long) sum.offloads, (unsigned long long) sum.refused,
+             (unsigned long long) sum.replay, (unsigned long long) sum.explore,
+             seconds(sum.solver), (unsigned long long) sum.recoveries,
+             (unsigned long long) sum.peakRSS,
+             (unsigned long long) traces[r].header.dropped);
+      dropped += traces[r].header.dropped;
+      total.peakRSS = std::max(total.peakRSS, sum.peakRSS);
+      if (traces[r].header.rank < 2)
+        continue;
+      ++workers;
+      busy += busyShare(sum, span);
+      total.idle += sum.idle;
+      total.tasks += sum.tasks;
+      total.offloads += sum.offloads;
+      total.refused += sum.refused;
+      total.replay += sum.replay;
+      total.explore += sum.explore;
+      total.solver += sum.solver;
+      total.recoveries += sum.recoveries;
+    }
+    printf("-1,%.6f,%.4f,%.6f,%llu,%llu,%llu,%llu,%llu,%.6f,%llu,%llu,%llu\n",
+           seconds(span), workers ? busy / workers : 0.0, seconds(total.idle),
+           (unsigned long long) total.tasks, (unsigned long long) total.offloads,
+           (unsigned long long) total.refused, (unsigned long long) total.replay,
+           (unsigned long long) total.explore, seconds(total.solver),
+           (unsigned long long) total.recoveries,
+           (unsigned long long) total.peakRSS, (unsigned long long) dropped);
+  }
+
+  //share of the workers not waiting for a message in each bucket
+  void printTimeline(const std::vector<RankTrace> &traces, uint64_t span) {
+    if (!span)
+      return;
+    std::vector<double> idle(TIMELINE_BUCKETS, 0);
+    unsigned workers = 0;
+    for (unsigned r = 0; r < traces.size(); ++r) {
+      if (traces[r].header.rank < 2)
+        continue;
+      ++workers;
+      for (unsigned i = 0; i < traces[r].events.size(); ++i) {
+        const EventTrace::Event &e = traces[r].events[i];
+        if (e.kind != EventTrace::Idle)
+          continue;
+        uint64_t begin = e.time - std::min(e.time, e.value);
+        for (unsigned b = begin * TIMELINE_BUCKETS / span;
+             b < TIMELINE_BUCKETS && b * span / TIMELINE_BUCKETS < e.time; ++b) {
+          uint64_t lo = std::max(begin, b * span / TIMELINE_BUCKETS);
+          uint64_t hi = std::min(e.time, (b + 1) * span / TIMELINE_BUCKETS);
+          if (hi > lo)
+            idle[b] += (double) (hi - lo) * TIMELINE_BUCKETS / span;
+        }
+      }
+    }
+    if (!workers)
+      return;
+
+    printf("\nutilization of %u workers:\n", workers);
+    for (unsigned b = 0; b < TIMELINE_BUCKETS; ++b) {
+      double used = 1 - std::min(1.0, idle[b] / workers);
+      unsigned bar = (unsigned) (used * 50 + 0.5);
+      printf("%9.2fs |%s%s| %3.0f%%\n", seconds(b * span / TIMELINE_BUCKETS),
+             std::string(bar, '#').c_str(), std::string(50 - bar, '.').c_str(),
+             100 * used);
+    }
+  }
+
+  //walks back from the task that finished last, a task started by an
+  //offload is charged to the rank whose successful reply came last before
+  //it, the master matches donors to idle ranks, so this is approximate
+  void printCriticalPath(const std::vector<RankTrace> &traces,
+                         const std::vector<Task> &tasks) {
+    if (tasks.empty())
+      return;
+    std::vector<std::pair<uint64_t, int> > replies;
+    for (unsigned r = 0; r < traces.size(); ++r) {
+      for (unsigned i = 0; i < traces[r].events.size(); ++i) {
+        const EventTrace::Event &e = traces[r].events[i];
+        if (e.kind == EventTrace::OffloadResponse && e.value)
+          replies.push_back(std::make_pair(e.time, traces[r].header.rank));
+      }
+    }
+    std::sort(replies.begin(), replies.end());
+
+    const Task *task = &tasks[0];
+    for (unsigned i = 1; i < tasks.size(); ++i) {
+      if (tasks[i].finish > task->finish)
+        task = &tasks[i];
+    }
+
+    printf("\ncritical path, last first:\n");
+    for (unsigned steps = 0; task && steps < tasks.size(); ++steps) {
+      printf("  rank %d %.3fs - %.3fs\n", task->rank, seconds(task->start),
+             seconds(task->finish));
+      std::vector<std::pair<uint64_t, int> >::iterator it =
+        std::lower_bound(replies.begin(), replies.end(),
+                         std::make_pair(task->start, -1));
+      const Task *donor = 0;
+      while (!donor && it != replies.begin()) {
+        --it;
+        for (unsigned i = 0; i < tasks.size(); ++i) {
+          if (tasks[i].rank == it->second && tasks[i].start <= it->first &&
+              it->first <= tasks[i].finish && &tasks[i] != task) {
+            donor = &tasks[i];
+            break;
+          }
+        }
+      }
+      task = donor;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int first = 1;
+  bool csv = argc > 1 && !strcmp(argv[1], "-csv");
+  if (csv)
+    ++first;
+  if (argc <= first) {
+    fprintf(stderr, "usage: %s [-csv] <trace.N>...\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<RankTrace> traces(argc - first);
+  for (int i = first; i < argc; ++i) {
+    if (!readTrace(argv[i], traces[i - first])) {
+      fprintf(stderr, "%s: not an event trace\n", argv[i]);
+      return 1;
+    }
+  }
+
+  uint64_t span = 0;
+  std::vector<Task> tasks;
+  for (unsigned r = 0; r < traces.size(); ++r) {
+    if (!traces[r].events.empty())
+      span = std::max(span, traces[r].events.back().time);
+    collectTasks(traces[r], tasks);
+  }
+
+  if (csv) {
+    printCSV(traces, span);
+    return 0;
+  }
+
+  printf("run: %.3fs over %u ranks\n\n", seconds(span), (unsigned) traces.size());
+  for (unsigned r = 0; r < traces.size(); ++r)
+    printRank(traces[r], span);
+  printTimeline(traces, span);
+  printCriticalPath(traces, tasks);
+  return 0;
+}
@@ -22,6 +22,12 @@
 #include "klee/Internal/Support/PrintVersion.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/Internal/Analysis/Annotator.h"
+#include "SharedQueryCache.h"
+#include "CoverageShare.h"
+#include "Checkpoint.h"
+#include "EventTrace.h"
+#include "NodeTopology.h"
+#include "TestPack.h"
 
 
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 2)
@@ -91,6 +97,22 @@ using namespace klee;
 #define KILL_COMP 8
 #define READY_TO_OFFLOAD 9
 #define NOT_READY_TO_OFFLOAD 10
+#define STEAL_REQ 11
+#define STEAL_RESP 12
+#define STEAL_GRANTED 13
+#define STEAL_TASK 14
+#define OFFLOAD_PKT 15
+#define MEMORY_PRESSURE 16
+#define NEW_TASK 17
+#define CHECKPOINT 18
+#define CHECKPOINT_RESP 19
+#define GROUP_STATUS 20
+#define GROUP_TASK 21
+#define STEAL_ACK 22
+
+//control messages are a tag plus at most a packet length, or the
+//four counters of a GROUP_STATUS
+#define CTRL_MSG_SIZE 16
 
 #define PREFIX_MODE 101
 #define RANGE_MODE 102
@@ -187,6 +209,12 @@ namespace {
   WriteSymPaths("write-sym-paths",
                 cl::desc("Write .sym.path files for each test case"));
 
+  cl::opt<bool>
+  TestPack("test-pack",
+           cl::desc("Append the test files to tests.pack in the output directory from "
+                    "a background thread instead of writing one file each "
+                    "(default=off)"));
+
   cl::opt<bool>
   ExitOnError("exit-on-error",
               cl::desc("Exit if errors occur"));
@@ -283,12 +311,6 @@ namespace {
                  cl::value_desc("policy name"),
                  cl::init("DFS"));
 
-  cl::opt<std::string>
-  offloadPolicy("offloadPolicy",
-                 cl::desc("policy name"),
-                 cl::value_desc("policy name"),
-                 cl::init("DEFAULT"));
-
   cl::list<std::string>
   SeedOutFile("seed-out");
 
@@ -321,9 +343,31 @@ namespace {
   lb("lb",
     	cl::desc("load balance"),
     	cl::init(false));
+
+  cl::opt<unsigned>
+  CheckpointInterval("checkpoint-interval",
+                     cl::desc("Seconds between two checkpoints with -checkpoint (default=600)"),
+                     cl::init(600));
+
+  cl::opt<std::string>
+  RestartFrom("restart-from",
+              cl::desc("Start from the prefixes of a -checkpoint file instead of "
+                       "running phase 1"),
+              cl::init(""));
+
+  cl::opt<unsigned>
+  GroupSize("group-size",
+            cl::desc("Workers per group coordinator with -lb: the lowest rank of each "
+                     "group of a node balances the others instead of exploring and only "
+                     "it talks to the master (default=0 (no groups))"),
+            cl::init(0));
 }
 
 extern cl::opt<double> MaxTime;
+extern cl::opt<bool> P2PSteal;
+extern cl::opt<std::string> CheckpointFile;
+extern cl::opt<unsigned> SuspendedStateBudget;
+extern unsigned Phase1StreamedTasks;
 
 
 typedef std::pair<const llvm::Value *, uint64_t> AllocSite;
@@ -348,6 +392,7 @@ private:
   Interpreter *m_interpreter;
   TreeStreamWriter *m_pathWriter, *m_symPathWriter;
   llvm::raw_ostream *m_infoFile;
+  TestPackWriter *m_testPack;
 
   SmallString<128> m_outputDirectory;
   std::string outputFileName;
@@ -407,6 +452,9 @@ public:
   llvm::raw_fd_ostream *openOutputFile(const std::string &filename, bool openOutside = false);
   std::string getTestFilename(const std::string &suffix, unsigned id);
   llvm::raw_fd_ostream *openTestFile(const std::string &suffix, unsigned id);
+  /// Writes test<id>.<suffix>, to the pack with -test-pack.
+  void writeTestFile(const std::string &suffix, unsigned id,
+                     const std::string &data);
 
   // load a .path file
   static void loadPathFile(std::string name,
@@ -423,6 +471,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
     m_pathWriter(0),
     m_symPathWriter(0),
     m_infoFile(0),
+    m_testPack(0),
     m_outputDirectory(),
     m_testIndex(0),
     m_pathsExplored(0),
@@ -497,6 +546,12 @@ KleeHandler::KleeHandler(int argc, char **argv)
 
   // open info
   m_infoFile = openOutputFile("info");
+
+  if (TestPack) {
+    m_testPack = new TestPackWriter(getOutputFilename("tests.pack"), argc, argv);
+    if (!m_testPack->good())
+      klee_error("cannot open \"%s\"", getOutputFilename("tests.pack").c_str());
+  }
 }
 
 std::string KleeHandler::getOutputDir() {
@@ -504,6 +559,7 @@ std::string KleeHandler::getOutputDir() {
 }
 
 KleeHandler::~KleeHandler() {
+  delete m_testPack;
   if (m_pathWriter) delete m_pathWriter;
   if (m_symPathWriter) delete m_symPathWriter;
   fclose(klee_warning_file);
@@ -572,6 +628,19 @@ llvm::raw_fd_ostream *KleeHandler::openTestFile(const std::string &suffix,
   return openOutputFile(getTestFilename(suffix, id));
 }
 
+void KleeHandler::writeTestFile(const std::string &suffix, unsigned id,
+                                const std::string &data) {
+  if (m_testPack) {
+    m_testPack->add(id, suffix, data);
+    return;
+  }
+  llvm::raw_ostream *f = openTestFile(suffix, id);
+  if (f) {
+    *f << data;
+    delete f;
+  }
+}
+
 
 /* Outputs all files (.ktest, .kquery, .cov etc.) describing a test case */
 void KleeHandler::processTestCase(const ExecutionState &state,
@@ -593,7 +662,10 @@ void KleeHandler::processTestCase(const ExecutionState &state,
 
     unsigned id = ++m_testIndex;
 
-    if (success) {
+    if (success && m_testPack) {
+      //encoded and written by the pack thread
+      m_testPack->addKTest(id, out);
+    } else if (success) {
       KTest b;
       b.numArgs = m_argc;
       b.args = m_argv;
@@ -621,30 +693,27 @@ void KleeHandler::processTestCase(const ExecutionState &state,
     }
 
     if (errorMessage) {
-      llvm::raw_ostream *f = openTestFile(errorSuffix, id);
-      *f << errorMessage;
-      delete f;
+      writeTestFile(errorSuffix, id, errorMessage);
     }
 
     if (m_pathWriter) {
       std::vector<unsigned char> concreteBranches;
       m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
                                concreteBranches);
-      llvm::raw_fd_ostream *f = openTestFile("path", id);
+      std::string path;
       for (std::vector<unsigned char>::iterator I = concreteBranches.begin(),
                                                 E = concreteBranches.end();
            I != E; ++I) {
-        *f << *I << "\n";
+        path += *I;
+        path += '\n';
       }
-      delete f;
+      writeTestFile("path", id, path);
     }
 
     if (errorMessage || WriteKQueries) {
       std::string constraints;
       m_interpreter->getConstraintLog(state, constraints,Interpreter::KQUERY);
-      llvm::raw_ostream *f = openTestFile("kquery", id);
-      *f << constraints;
-      delete f;
+      writeTestFile("kquery", id, constraints);
     }
 
     if (WriteCVCs) {
@@ -652,43 +721,41 @@ void KleeHandler::processTestCase(const ExecutionState &state,
       // SMT-LIBv2 not CVC which is a bit confusing
       std::string constraints;
       m_interpreter->getConstraintLog(state, constraints, Interpreter::STP);
-      llvm::raw_ostream *f = openTestFile("cvc", id);
-      *f << constraints;
-      delete f;
+      writeTestFile("cvc", id, constraints);
     }
 
     if(WriteSMT2s) {
       std::string constraints;
         m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
-        llvm::raw_ostream *f = openTestFile("smt2", id);
-        *f << constraints;
-        delete f;
+        writeTestFile("smt2", id, constraints);
     }
 
     if (m_symPathWriter) {
       std::vector<unsigned char> symbolicBranches;
       m_symPathWriter->readStream(m_interpreter->getSymbolicPathStreamID(state),
                                   symbolicBranches);
-      llvm::raw_fd_ostream *f = openTestFile("sym.path", id);
+      std::string path;
       for (std::vector<unsigned char>::iterator I = symbolicBranches.begin(), E = symbolicBranches.end(); I!=E; ++I) {
-        *f << *I << "\n";
+        path += *I;
+        path += '\n';
       }
-      delete f;
+      writeTestFile("sym.path", id, path);
     }
 
     if (WriteCov) {
       std::map<const std::string*, std::set<unsigned> > cov;
       m_interpreter->getCoveredLines(state, cov);
-      llvm::raw_ostream *f = openTestFile("cov", id);
+      std::string lines;
+      llvm::raw_string_ostream f(lines);
       for (std::map<const std::string*, std::set<unsigned> >::iterator
              it = cov.begin(), ie = cov.end();
            it != ie; ++it) {
         for (std::set<unsigned>::iterator
                it2 = it->second.begin(), ie = it->second.end();
              it2 != ie; ++it2)
-          *f << *it->first << ":" << *it2 << "\n";
+          f << *it->first << ":" << *it2 << "\n";
       }
-      delete f;
+      writeTestFile("cov", id, f.str());
     }
 
     if (m_testIndex == StopAfterNTests)
@@ -696,10 +763,11 @@ void KleeHandler::processTestCase(const ExecutionState &state,
 
     if (WriteTestInfo) {
       double elapsed_time = util::getWallTime() - start_time;
-      llvm::raw_ostream *f = openTestFile("info", id);
-      *f << "Time to generate test case: "
-         << elapsed_time << "s\n";
-      delete f;
+      std::string info;
+      llvm::raw_string_ostream f(info);
+      f << "Time to generate test case: "
+        << elapsed_time << "s\n";
+      writeTestFile("info", id, f.str());
     }
   }
 }
@@ -1329,21 +1397,29 @@ bool parseNameLineOption(
 
     return true;
 }
+//resident per-rank runtime, built once by setupWorker and reused by every
+//task the worker receives
 struct SysPointers {
   Module *module;
+  Function *mainFn;
   Interpreter *interpreter;
   KleeHandler *handler;
   int pArgc;
   char **pArgv;
   char **pEnvp;
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  OwningPtr<MemoryBuffer> BufferPtr;
+#endif
 };
 
 int master(int argc, char **argv, char **envp);
 void worker(int argc, char **argv, char **envp);
+void coordinateGroup();
 
-int executeWorker(int argc, char **argv, char **envp, 
-	char** workList, char* prefix, unsigned int count,
+int setupWorker(int argc, char **argv, char **envp, SysPointers &sp);
+int executeWorker(SysPointers &sp, char* prefix, unsigned int count,
   int explorationDepth=0, int mode=NO_MODE, std::string searchMode="DFS");
+void finishWorker(SysPointers &sp);
 
 std::vector<std::string> split(const std::string& s, char delimiter)
 {
@@ -1412,11 +1488,17 @@ void parseErrorLocationParameter(std::string parameter, std::map<std::string, st
 }
 
 void timeOutCheck() {
-  if(timeOut!=0) {
-   sleep(timeOut);
-  } else { 
-    sleep(86400);
+  unsigned left = timeOut != 0 ? (unsigned) timeOut : 86400;
+  //the master has no timer, it starts a checkpoint round on every tick
+  bool ticks = !CheckpointFile.empty() && phase1Depth != 0 && !(lb && P2PSteal) &&
+    !theNodeTopology->hasGroups();
+  while(ticks && CheckpointInterval && left > CheckpointInterval) {
+    sleep(CheckpointInterval);
+    left -= CheckpointInterval;
+    char tick;
+    MPI_Send(&tick, 1, MPI_CHAR, 0, CHECKPOINT, MPI_COMM_WORLD);
   }
+  sleep(left);
   //MPI_Abort(MPI_COMM_WORLD, -1);
   char dummy;
   MPI_Send(&dummy, 1, MPI_CHAR, 0, TIMEOUT, MPI_COMM_WORLD);
@@ -1433,7 +1515,17 @@ int main(int argc, char **argv, char **envp) {
   sys::SetInterruptFunction(interrupt_handle);
 
 	/*MPI Parallel Code should go here*/
-	MPI_Init(NULL, NULL);
+	//the -test-pack and -checkpoint writers run in their own threads, only
+	//the main thread makes MPI calls
+	int provided;
+	MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
+	if(provided < MPI_THREAD_FUNNELED)
+		klee_error("the MPI library does not support MPI_THREAD_FUNNELED");
+	SharedQueryCache::initialize();
+	CoverageShare::initialize();
+	//groups only take over what the master balances
+	NodeTopology::initialize(lb && !P2PSteal && phase1Depth != 0 ? GroupSize : 0);
+	EventTrace::initialize();
 
 	int world_rank;
 	MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
@@ -1442,10 +1534,16 @@ int main(int argc, char **argv, char **envp) {
   	master(argc, argv, envp);
 	} else if(world_rank == 1) {
   	timeOutCheck();
+	} else if(theNodeTopology->isCoordinator()) {
+  	coordinateGroup();
 	} else { //workers
   	worker(argc, argv, envp);
 	}
 
+	EventTrace::finalize();
+	NodeTopology::finalize();
+	CoverageShare::finalize();
+	SharedQueryCache::finalize();
 	MPI_Finalize();
 	return 0;
 }
@@ -1464,6 +1562,841 @@ std::string getNewSearch() {
 	}
 }
 
+//what the master tracks per rank, indexed by the rank
+struct WorkerSlot {
+  bool started;      //ran a task, answers KILL with KILL_COMP
+  bool killed;       //spare rank sent away at seeding
+  bool busy;
+  bool free;         //queued in the free queue
+  bool offloadReady; //queued in the ready set
+  bool offloadSent;  //an OFFLOAD is outstanding
+  bool memoryPressure; //last reported over -max-memory
+  bool checkpointPending; //a CHECKPOINT is outstanding
+  unsigned readySeq;
+  int task;          //worklist index being run, -1 if none
+  double taskStart;
+  //-checkpoint: the tasks the rank holds as of its last report, and the
+  //ones sent after the CHECKPOINT it is answering
+  std::deque< std::vector<char> > frontier, sentSinceRequest;
+  WorkerSlot() : started(false), killed(false), busy(false), free(false),
+    offloadReady(false), offloadSent(false), memoryPressure(false),
+    checkpointPending(false), readySeq(0), task(-1),
+    taskStart(0) {}
+};
+
+//a task sent is part of the rank's frontier until the rank reports one
+static void sendTask(int rank, const char *packet, unsigned len,
+    WorkerSlot &slot, bool record) {
+  MPI_Send(packet, len, MPI_CHAR, rank, START_PREFIX_TASK, MPI_COMM_WORLD);
+  if(!record) return;
+  slot.frontier.push_back(std::vector<char>(packet, packet + len));
+  if(slot.checkpointPending) slot.sentSinceRequest.push_back(slot.frontier.back());
+}
+
+//asks the busy workers not asked yet for their frontier, returns how many
+static int requestCheckpoint(int num_cores, std::vector<WorkerSlot> &slots) {
+  int requested = 0;
+  char dummy;
+  for(int x=2; x<num_cores; ++x) {
+    if(!slots[x].busy || slots[x].checkpointPending) continue;
+    MPI_Send(&dummy, 1, MPI_CHAR, x, CHECKPOINT, MPI_COMM_WORLD);
+    slots[x].checkpointPending = true;
+    slots[x].sentSinceRequest.clear();
+    ++requested;
+  }
+  return requested;
+}
+
+//the unsent worklist, the queued split tasks and every rank's frontier
+static bool writeCheckpoint(CheckpointWriter *checkpointer, bool wait,
+    char **workList, std::vector<unsigned int> &pathSizes, unsigned cnt,
+    std::deque< std::vector<char> > &splitTasks, std::vector<WorkerSlot> &slots,
+    std::ofstream &masterLog) {
+  CheckpointImage image;
+  for(unsigned x=cnt; x<pathSizes.size(); ++x)
+    image.add(workList[x], pathSizes[x]);
+  for(auto it=splitTasks.begin(); it!=splitTasks.end(); ++it)
+    image.add(*it);
+  for(unsigned x=2; x<slots.size(); ++x)
+    for(auto it=slots[x].frontier.begin(); it!=slots[x].frontier.end(); ++it)
+      image.add(*it);
+  masterLog << "MASTER: CHECKPOINT Tasks:"<<image.numTasks<<" Bytes:"<<image.tasks.size()<<"\n";
+  if(!wait) {
+    checkpointer->submit(image);
+    return true;
+  }
+  bool ok = checkpointer->write(image);
+  if(!ok) klee_warning("cannot write checkpoint '%s'", CheckpointFile.c_str());
+  return ok;
+}
+
+static void postControlRecv(int rank, std::vector<char> &ctrl,
+    std::vector<MPI_Request> &reqs) {
+  MPI_Irecv(&ctrl[rank*CTRL_MSG_SIZE], CTRL_MSG_SIZE, MPI_CHAR, rank,
+      MPI_ANY_TAG, MPI_COMM_WORLD, &reqs[rank]);
+}
+
+static void logElapsed(std::ofstream &masterLog, time_t *t) {
+  char buf[256];
+  t[1] = time(NULL);
+  strcpy(buf, "Elapsed: ");
+  strcpy(format_tdiff(buf, t[1] - t[0]), "\n");
+  masterLog<<buf;
+}
+
+//kills the running ranks among \param ranks and waits for them to tear down
+static void shutdownWorkers(const std::vector<int> &ranks,
+    std::vector<WorkerSlot> &slots, std::vector<MPI_Request> &reqs) {
+  char dummy;
+  for(unsigned i=0; i<ranks.size(); ++i) {
+    if(!slots[ranks[i]].killed) {
+      MPI_Send(&dummy, 1, MPI_CHAR, ranks[i], KILL, MPI_COMM_WORLD);
+    }
+  }
+
+  //withdraw the posted receives, one of them may already hold a KILL_COMP
+  std::vector<bool> done(reqs.size(), false);
+  for(unsigned x=0; x<reqs.size(); ++x) {
+    if(reqs[x] == MPI_REQUEST_NULL) continue;
+    MPI_Status status;
+    int cancelled;
+    MPI_Cancel(&reqs[x]);
+    MPI_Wait(&reqs[x], &status);
+    MPI_Test_cancelled(&status, &cancelled);
+    if(!cancelled && status.MPI_TAG == KILL_COMP) done[x] = true;
+  }
+  for(unsigned i=0; i<ranks.size(); ++i) {
+    int x = ranks[i];
+    if(slots[x].started && !done[x]) {
+      MPI_Status status;
+      MPI_Recv(&dummy, 1, MPI_CHAR, x, KILL_COMP, MPI_COMM_WORLD, &status);
+    }
+  }
+}
+
+//hands out one OFFLOAD per idle worker not yet promised to an offload, the
+//workers short of memory and then the longest ready first. The request
+//tells the victim how many ranks are idle and how many are being asked,
+//for -offloadPolicy
+static void requestOffloads(unsigned idle, int &pendingOffloads,
+    std::set<int> &pressureSet, std::set< std::pair<unsigned, int> > &readySet,
+    std::vector<WorkerSlot> &slots, std::ofstream &log) {
+  while(((int) idle > pendingOffloads) &&
+      (!pressureSet.empty() || !readySet.empty())) {
+    uint32_t hint[2];
+    hint[0] = idle - pendingOffloads;
+    hint[1] = std::min(hint[0], (uint32_t) (readySet.size() + pressureSet.size()));
+    int victim;
+    if(!pressureSet.empty()) {
+      victim = *pressureSet.begin();
+      pressureSet.erase(pressureSet.begin());
+      if(slots[victim].offloadReady)
+        readySet.erase(std::make_pair(slots[victim].readySeq, victim));
+    } else {
+      victim = readySet.begin()->second;
+      readySet.erase(readySet.begin());
+    }
+    MPI_Send(hint, sizeof(hint), MPI_CHAR, victim, OFFLOAD, MPI_COMM_WORLD);
+    log << "MASTER->WORKER: OFFLOAD_SENT ID:"<<victim<<"\n";
+    if(FLUSH) log.flush();
+    slots[victim].offloadSent = true;
+    ++pendingOffloads;
+  }
+}
+
+//READY_TO_OFFLOAD, NOT_READY_TO_OFFLOAD and MEMORY_PRESSURE of \param src
+static void updateReadiness(int tag, int src, char pressure, WorkerSlot &slot,
+    std::set<int> &pressureSet, std::set< std::pair<unsigned, int> > &readySet,
+    unsigned &readyCounter, std::ofstream &log) {
+  if(tag == READY_TO_OFFLOAD) {
+    if(slot.busy && !slot.offloadReady && !slot.offloadSent) {
+      slot.readySeq = readyCounter++;
+      readySet.insert(std::make_pair(slot.readySeq, src));
+    }
+    slot.offloadReady = slot.busy;
+  } else if(tag == NOT_READY_TO_OFFLOAD) {
+    if(slot.offloadReady && !slot.offloadSent) {
+      readySet.erase(std::make_pair(slot.readySeq, src));
+    }
+    slot.offloadReady = false;
+  } else {
+    slot.memoryPressure = pressure != 0;
+    log << "WORKER->MASTER: MEMORY_PRESSURE ID:"<<src<<" On:"<<slot.memoryPressure<<"\n";
+    if(slot.memoryPressure && slot.busy && !slot.offloadSent) {
+      pressureSet.insert(src);
+    } else if(!slot.memoryPressure) {
+      pressureSet.erase(src);
+    }
+  }
+}
+
+//the OFFLOAD of \param src is answered, \param gave if with a packet
+static void offloadAnswered(int src, bool gave, WorkerSlot &slot,
+    std::set<int> &pressureSet, std::set< std::pair<unsigned, int> > &readySet,
+    unsigned &readyCounter) {
+  slot.offloadSent = false;
+  //still loaded, it stays a candidate behind the others
+  if(slot.offloadReady) {
+    slot.readySeq = readyCounter++;
+    readySet.insert(std::make_pair(slot.readySeq, src));
+  }
+  //short of memory and still giving states, ask it again first
+  if(slot.memoryPressure && slot.busy && gave) {
+    pressureSet.insert(src);
+  }
+}
+
+//leaves FINISHed \param src out of the offload candidates
+static void workerIdle(int src, WorkerSlot &slot, std::set<int> &pressureSet,
+    std::set< std::pair<unsigned, int> > &readySet) {
+  if(slot.offloadReady) {
+    readySet.erase(std::make_pair(slot.readySeq, src));
+    slot.offloadReady = false;
+  }
+  pressureSet.erase(src);
+}
+
+//event loop of the master once phase 1 produced the worklist: one posted
+//receive per rank, indexed worker tables and one outstanding OFFLOAD per
+//free worker
+void coordinateWorkers(int num_cores, char **workList,
+    std::vector<unsigned int> &pathSizes, std::ofstream &masterLog, time_t *t) {
+
+  std::vector<WorkerSlot> slots(num_cores);
+  std::vector<int> workers;
+  for(int x=2; x<num_cores; ++x) workers.push_back(x);
+  std::deque<int> freeQueue;
+  std::set< std::pair<unsigned, int> > readySet; //oldest ready first
+  std::set<int> pressureSet; //busy workers over their memory cap, go first
+  std::deque< std::vector<char> > splitTasks; //-split-bounded-states packets
+  unsigned readyCounter = 0;
+  int numBusy = 0, pendingOffloads = 0;
+
+  //with stealing the master only counts the tasks in flight: the prefixes
+  //it sent plus the steals granted, minus the FINISH messages
+  bool p2p = lb && P2PSteal;
+
+  //-checkpoint: stolen work never passes the master, it can not be saved
+  CheckpointWriter *checkpointer = 0;
+  if(!CheckpointFile.empty()) {
+    if(p2p)
+      klee_warning("-checkpoint is ignored with -p2p-steal");
+    else
+      checkpointer = new CheckpointWriter(CheckpointFile);
+  }
+  int pendingCheckpoints = 0;
+  bool draining = false; //the last checkpoint before a timeout is running
+
+  //*************Seeding the worker*************
+  //with -pipeline-phase1 the first ranks already got a prefix during phase 1
+  unsigned int cnt = 0;
+  int currRank = 2;
+  for(unsigned x=0; x<Phase1StreamedTasks; ++x, ++currRank) {
+    masterLog << "MASTER->WORKER: STREAMED_WORK ID:"<<currRank<<"\n";
+    slots[currRank].started = true;
+    slots[currRank].busy = true;
+    ++numBusy;
+  }
+  for(; currRank < num_cores && cnt < pathSizes.size(); ++currRank, ++cnt) {
+    std::cout << "Starting worker: "<<currRank<<"\n";
+    masterLog << "MASTER->WORKER: START_WORK ID:"<<currRank<<"\n";
+    if(FLUSH) masterLog.flush();
+    sendTask(currRank, workList[cnt], pathSizes[cnt], slots[currRank], checkpointer != 0);
+    slots[currRank].task = cnt;
+    slots[currRank].taskStart = util::getWallTime();
+    slots[currRank].started = true;
+    slots[currRank].busy = true;
+    ++numBusy;
+  }
+
+  int outstandingTasks = cnt + Phase1StreamedTasks;
+
+  //If worklist size is smaller than cores, kill the rest of the processes
+  for(; currRank < num_cores; ++currRank) {
+    char dummy2;
+    if(p2p) {
+      //spare ranks start out by stealing from the seeded ones
+      MPI_Send(&dummy2, 1, MPI_CHAR, currRank, STEAL_TASK, MPI_COMM_WORLD);
+      masterLog << "MASTER->WORKER: STEAL_TASK ID:"<<currRank<<"\n";
+      slots[currRank].started = true;
+    } else if(!lb) {
+      MPI_Send(&dummy2, 1, MPI_CHAR, currRank, KILL, MPI_COMM_WORLD);
+      std::cout << "Killing(not required) worker: "<<currRank<<"\n";
+      masterLog << "MASTER->WORKER: KILL ID:"<<currRank<<"\n";
+      slots[currRank].killed = true;
+    } else {
+      slots[currRank].free = true;
+      freeQueue.push_back(currRank);
+    }
+  }
+
+  std::vector<char> ctrl(num_cores*CTRL_MSG_SIZE);
+  std::vector<MPI_Request> reqs(num_cores, MPI_REQUEST_NULL);
+  for(int x=1; x<num_cores; ++x) {
+    postControlRecv(x, ctrl, reqs);
+  }
+
+  while(true) {
+    //if all workers finish then shut down the system
+    bool allDone = p2p ? (outstandingTasks == 0) :
+      (cnt == pathSizes.size() && numBusy == 0 && pendingOffloads == 0 &&
+       splitTasks.empty());
+    if(allDone) {
+      masterLog << "MASTER: ALL WORKERS FINISHED \n";
+      if(FLUSH) masterLog.flush();
+      //nothing is left, a restart from it does nothing
+      if(checkpointer)
+        writeCheckpoint(checkpointer, true, workList, pathSizes, cnt, splitTasks,
+            slots, masterLog);
+      shutdownWorkers(workers, slots, reqs);
+      masterLog << "MASTER_ELAPSED: \n";
+      logElapsed(masterLog, t);
+      masterLog.close();
+      if(theEventTrace) theEventTrace->dump();
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    //queued tasks go to the free workers before anyone is asked to offload
+    while(!p2p && !draining && !splitTasks.empty() &&
+        (int) freeQueue.size() > pendingOffloads) {
+      int pickedWorker = freeQueue.front();
+      freeQueue.pop_front();
+      std::vector<char> &packet = splitTasks.front();
+      sendTask(pickedWorker, &packet[0], packet.size(), slots[pickedWorker], checkpointer != 0);
+      masterLog << "MASTER->WORKER: SPLIT_TASK_SEND ID:"<<pickedWorker<<" Length:"<<packet.size()<<"\n";
+      splitTasks.pop_front();
+      slots[pickedWorker].free = false;
+      slots[pickedWorker].started = true;
+      slots[pickedWorker].busy = true;
+      ++numBusy;
+    }
+
+    if(lb && !p2p && !draining)
+      requestOffloads(freeQueue.size(), pendingOffloads, pressureSet, readySet,
+          slots, masterLog);
+
+    int src;
+    MPI_Status status;
+    {
+      EventTraceSpan idle(EventTrace::Idle);
+      MPI_Waitany(num_cores, &reqs[0], &src, &status);
+    }
+    assert(src != MPI_UNDEFINED && "master has no posted receives");
+    int count;
+    MPI_Get_count(&status, MPI_CHAR, &count);
+    WorkerSlot &slot = slots[src];
+
+    if(status.MPI_TAG == FINISH) {
+      masterLog << "WORKER->MASTER: FINISH ID:"<<src<<"\n";
+      if(slot.busy) {
+        slot.busy = false;
+        --numBusy;
+      }
+      workerIdle(src, slot, pressureSet, readySet);
+      if(p2p) --outstandingTasks;
+      //its bounded states came in as NEW_TASK before, nothing is left there
+      slot.frontier.clear();
+      //the worklist is sent largest estimate first, this is the real cost
+      //(including any work the worker received meanwhile)
+      if(slot.task >= 0) {
+        masterLog << "MASTER: TASK_COST Task:"<<slot.task<<" ID:"<<src
+          <<" Seconds:"<<util::getWallTime() - slot.taskStart<<"\n";
+        slot.task = -1;
+      }
+
+      if(draining) {
+        //no new work while the last checkpoint runs
+      } else if(cnt < pathSizes.size()) {
+        sendTask(src, workList[cnt], pathSizes[cnt], slot, checkpointer != 0);
+        masterLog << "MASTER->WORKER: START_WORK ID:"<<src<<"\n";
+        slot.task = cnt;
+        slot.taskStart = util::getWallTime();
+        slot.busy = true;
+        ++numBusy;
+        ++cnt;
+        if(p2p) ++outstandingTasks;
+        if(cnt == pathSizes.size()) {
+          std::cout << "Done with all prefixes\n";
+          masterLog << "MASTER: DONE_WITH_ALL_PREFIXES\n";
+        }
+      } else if(!splitTasks.empty()) {
+        //counted in outstandingTasks when it arrived
+        std::vector<char> &packet = splitTasks.front();
+        sendTask(src, &packet[0], packet.size(), slot, checkpointer != 0);
+        masterLog << "MASTER->WORKER: SPLIT_TASK_SEND ID:"<<src<<" Length:"<<packet.size()<<"\n";
+        splitTasks.pop_front();
+        slot.busy = true;
+        ++numBusy;
+      }
+      if(!slot.busy && !p2p && !slot.free) {
+        slot.free = true;
+        freeQueue.push_back(src);
+      }
+      masterLog << "WORKER->MASTER: FREELIST SIZE:"<<freeQueue.size()<<"\n";
+      if(FLUSH) masterLog.flush();
+    } else if(status.MPI_TAG == BUG_FOUND) {
+      masterLog << "WORKER->MASTER:  BUG FOUND:"<<src<<"\n";
+      logElapsed(masterLog, t);
+      masterLog.close();
+      if(theEventTrace) theEventTrace->dump();
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    } else if(status.MPI_TAG == TIMEOUT) {
+      //the frontier is saved first, the shutdown follows the last report
+      if(checkpointer) {
+        draining = true;
+        pendingCheckpoints += requestCheckpoint(num_cores, slots);
+        masterLog << "MASTER: FINAL_CHECKPOINT Pending:"<<pendingCheckpoints<<"\n";
+      }
+      if(!pendingCheckpoints) {
+        if(checkpointer)
+          writeCheckpoint(checkpointer, true, workList, pathSizes, cnt, splitTasks,
+              slots, masterLog);
+        shutdownWorkers(workers, slots, reqs);
+        masterLog.close();
+        if(theEventTrace) theEventTrace->dump();
+        MPI_Abort(MPI_COMM_WORLD, -1);
+      }
+    } else if(status.MPI_TAG == CHECKPOINT) {
+      //a tick of the timeout rank, one round at a time
+      if(checkpointer && !draining && !pendingCheckpoints) {
+        pendingCheckpoints = requestCheckpoint(num_cores, slots);
+        if(!pendingCheckpoints)
+          writeCheckpoint(checkpointer, false, workList, pathSizes, cnt, splitTasks,
+              slots, masterLog);
+      }
+    } else if(status.MPI_TAG == CHECKPOINT_RESP) {
+      uint32_t len;
+      memcpy(&len, &ctrl[src*CTRL_MSG_SIZE], sizeof(len));
+      std::vector<char> batch(len);
+      if(len) {
+        MPI_Status pktStatus;
+        MPI_Recv(&batch[0], len, MPI_CHAR, src, OFFLOAD_PKT, MPI_COMM_WORLD, &pktStatus);
+      }
+      slot.frontier.clear();
+      unsigned numTasks = unpackTasks(batch, slot.frontier);
+      slot.frontier.insert(slot.frontier.end(), slot.sentSinceRequest.begin(),
+          slot.sentSinceRequest.end());
+      slot.sentSinceRequest.clear();
+      slot.checkpointPending = false;
+      --pendingCheckpoints;
+      masterLog << "WORKER->MASTER: CHECKPOINT_RESP ID:"<<src<<" Tasks:"<<numTasks<<"\n";
+      if(!pendingCheckpoints) {
+        writeCheckpoint(checkpointer, draining, workList, pathSizes, cnt, splitTasks,
+            slots, masterLog);
+        if(draining) {
+          shutdownWorkers(workers, slots, reqs);
+          masterLog.close();
+          if(theEventTrace) theEventTrace->dump();
+          MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+      }
+    } else if(status.MPI_TAG == STEAL_GRANTED) {
+      //counted before the thief may send the FINISH of the stolen task,
+      //it waits for this ack
+      int32_t thief;
+      memcpy(&thief, &ctrl[src*CTRL_MSG_SIZE], sizeof(thief));
+      ++outstandingTasks;
+      char ack;
+      MPI_Send(&ack, 1, MPI_CHAR, thief, STEAL_ACK, MPI_COMM_WORLD);
+      masterLog << "WORKER->MASTER: STEAL_GRANTED ID:"<<src<<" Thief:"<<thief
+        <<" OUTSTANDING:"<<outstandingTasks<<"\n";
+    } else if(status.MPI_TAG == READY_TO_OFFLOAD ||
+        status.MPI_TAG == NOT_READY_TO_OFFLOAD ||
+        status.MPI_TAG == MEMORY_PRESSURE) {
+      updateReadiness(status.MPI_TAG, src, ctrl[src*CTRL_MSG_SIZE], slot,
+          pressureSet, readySet, readyCounter, masterLog);
+    } else if(status.MPI_TAG == NEW_TASK) {
+      //u32-length-prefixed prefix packets, each one task
+      uint32_t len;
+      memcpy(&len, &ctrl[src*CTRL_MSG_SIZE], sizeof(len));
+      std::vector<char> batch(len);
+      MPI_Status pktStatus;
+      MPI_Recv(&batch[0], len, MPI_CHAR, src, OFFLOAD_PKT, MPI_COMM_WORLD, &pktStatus);
+      unsigned numTasks = unpackTasks(batch, splitTasks);
+      if(p2p) outstandingTasks += numTasks;
+      masterLog << "WORKER->MASTER: NEW_TASK ID:"<<src<<" Tasks:"<<numTasks
+        <<" Queued:"<<splitTasks.size()<<"\n";
+    } else if(status.MPI_TAG == OFFLOAD_RESP) {
+      masterLog << "WORKER->MASTER: OFFLOAD RCVD ID:"<<src<<" Length:"<<count<<"\n";
+      if(FLUSH) masterLog.flush();
+      --pendingOffloads;
+      offloadAnswered(src, count == sizeof(uint32_t), slot, pressureSet, readySet,
+          readyCounter);
+
+      //a successful reply announces the length of the packet that follows
+      if(count == sizeof(uint32_t)) {
+        uint32_t len;
+        memcpy(&len, &ctrl[src*CTRL_MSG_SIZE], sizeof(len));
+        std::vector<char> packet(len);
+        MPI_Status pktStatus;
+        MPI_Recv(&packet[0], len, MPI_CHAR, src, OFFLOAD_PKT, MPI_COMM_WORLD, &pktStatus);
+
+        if(draining) {
+          //kept for the last checkpoint instead
+          splitTasks.push_back(packet);
+        } else {
+          //a free worker was reserved when the OFFLOAD was sent
+          assert(!freeQueue.empty());
+          int pickedWorker = freeQueue.front();
+          freeQueue.pop_front();
+          slots[pickedWorker].free = false;
+          masterLog << "MASTER->WORKER: PREFIX_TASK_SEND ID:"<<pickedWorker<<" Length:"<<len<<"\n";
+          sendTask(pickedWorker, &packet[0], len, slots[pickedWorker], checkpointer != 0);
+          masterLog << "MASTER->WORKER: START_WORK ID:"<<pickedWorker<<"\n";
+          slots[pickedWorker].started = true;
+          slots[pickedWorker].busy = true;
+          ++numBusy;
+        }
+      }
+    } else {
+      //should not see any tags here
+      std::cout << "ILLEGAL TAG: "<<status.MPI_TAG<<" "<<src<<"\n";
+      if(FLUSH) std::cout.flush();
+      bool ok = false;
+      (void) ok;
+      assert(ok && "MASTER received an illegal tag");
+    }
+    postControlRecv(src, ctrl, reqs);
+  }
+}
+
+//a packet too large for the posted receive: its length as the control
+//message, the bytes under OFFLOAD_PKT
+static void sendPacket(int rank, int tag, const char *packet, uint32_t len) {
+  MPI_Send(&len, sizeof(len), MPI_CHAR, rank, tag, MPI_COMM_WORLD);
+  MPI_Send(packet, len, MPI_CHAR, rank, OFFLOAD_PKT, MPI_COMM_WORLD);
+}
+
+static void recvPacket(int rank, const std::vector<char> &ctrl,
+    std::vector<char> &packet) {
+  uint32_t len;
+  memcpy(&len, &ctrl[rank*CTRL_MSG_SIZE], sizeof(len));
+  packet.resize(len);
+  MPI_Status status;
+  MPI_Recv(&packet[0], len, MPI_CHAR, rank, OFFLOAD_PKT, MPI_COMM_WORLD, &status);
+}
+
+//-group-size: balances the workers of the group the way coordinateWorkers
+//does and only goes to the master for prefixes, for work moved between
+//groups and for termination. The master hears a GROUP_STATUS of busy
+//workers, idle workers, donors (workers to ask and queued tasks) and tasks
+//received whenever one of them changed
+void coordinateGroup() {
+  int num_cores, rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &num_cores);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  const std::vector<int> &members = theNodeTopology->getGroup();
+  std::ofstream groupLog;
+  groupLog.open("log_group_"+std::to_string(rank)+"_"+OutputDir);
+
+  std::vector<WorkerSlot> slots(num_cores);
+  std::deque<int> freeQueue;
+  std::set< std::pair<unsigned, int> > readySet;
+  std::set<int> pressureSet;
+  std::deque< std::vector<char> > tasks; //from the master and NEW_TASK
+  unsigned readyCounter = 0;
+  int numBusy = 0, pendingOffloads = 0;
+  uint32_t tasksReceived = 0;
+  int upstreamVictim = -1; //the member serving an OFFLOAD of the master
+  uint32_t reported[4] = { ~0u, ~0u, ~0u, ~0u };
+
+  for(unsigned i=0; i<members.size(); ++i) {
+    slots[members[i]].free = true;
+    freeQueue.push_back(members[i]);
+  }
+
+  std::vector<char> ctrl(num_cores*CTRL_MSG_SIZE);
+  std::vector<MPI_Request> reqs(num_cores, MPI_REQUEST_NULL);
+  postControlRecv(MASTER_NODE, ctrl, reqs);
+  for(unsigned i=0; i<members.size(); ++i)
+    postControlRecv(members[i], ctrl, reqs);
+
+  while(true) {
+    while(!tasks.empty() && (int) freeQueue.size() > pendingOffloads) {
+      int pickedWorker = freeQueue.front();
+      freeQueue.pop_front();
+      std::vector<char> &packet = tasks.front();
+      MPI_Send(&packet[0], packet.size(), MPI_CHAR, pickedWorker, START_PREFIX_TASK,
+          MPI_COMM_WORLD);
+      groupLog << "GROUP->WORKER: START_WORK ID:"<<pickedWorker<<" Length:"<<packet.size()<<"\n";
+      tasks.pop_front();
+      slots[pickedWorker].free = false;
+      slots[pickedWorker].started = true;
+      slots[pickedWorker].busy = true;
+      ++numBusy;
+    }
+    requestOffloads(freeQueue.size(), pendingOffloads, pressureSet, readySet,
+        slots, groupLog);
+
+    uint32_t status[4] = { (uint32_t) numBusy,
+      (uint32_t) (freeQueue.size() - std::min((int) freeQueue.size(), pendingOffloads)),
+      (uint32_t) (readySet.size() + pressureSet.size() + tasks.size()), tasksReceived };
+    if(memcmp(status, reported, sizeof(status))) {
+      MPI_Send(status, sizeof(status), MPI_CHAR, MASTER_NODE, GROUP_STATUS, MPI_COMM_WORLD);
+      memcpy(reported, status, sizeof(status));
+    }
+
+    int src;
+    MPI_Status mpiStatus;
+    {
+      EventTraceSpan idle(EventTrace::Idle);
+      MPI_Waitany(num_cores, &reqs[0], &src, &mpiStatus);
+    }
+    assert(src != MPI_UNDEFINED && "coordinator has no posted receives");
+    int count;
+    MPI_Get_count(&mpiStatus, MPI_CHAR, &count);
+    WorkerSlot &slot = slots[src];
+    int tag = mpiStatus.MPI_TAG;
+
+    if(src == MASTER_NODE) {
+      if(tag == KILL) {
+        groupLog << "MASTER->GROUP: KILL\n";
+        groupLog.close();
+        shutdownWorkers(members, slots, reqs);
+        if(theEventTrace) theEventTrace->dump();
+        char done;
+        MPI_Send(&done, 1, MPI_CHAR, MASTER_NODE, KILL_COMP, MPI_COMM_WORLD);
+        return;
+      } else if(tag == GROUP_TASK) {
+        tasks.push_back(std::vector<char>());
+        recvPacket(MASTER_NODE, ctrl, tasks.back());
+        ++tasksReceived;
+        groupLog << "MASTER->GROUP: TASK Queued:"<<tasks.size()<<"\n";
+      } else if(tag == OFFLOAD) {
+        //queued work first, then a member to ask, the master only asks
+        //once at a time
+        int victim = -1;
+        if(tasks.empty() && !pressureSet.empty()) {
+          victim = *pressureSet.begin();
+          pressureSet.erase(pressureSet.begin());
+          if(slots[victim].offloadReady)
+            readySet.erase(std::make_pair(slots[victim].readySeq, victim));
+        } else if(tasks.empty() && !readySet.empty()) {
+          victim = readySet.begin()->second;
+          readySet.erase(readySet.begin());
+        }
+        if(!tasks.empty()) {
+          std::vector<char> &packet = tasks.front();
+          sendPacket(MASTER_NODE, OFFLOAD_RESP, &packet[0], packet.size());
+          tasks.pop_front();
+        } else if(victim >= 0) {
+          MPI_Send(&ctrl[MASTER_NODE*CTRL_MSG_SIZE], 2*sizeof(uint32_t), MPI_CHAR,
+              victim, OFFLOAD, MPI_COMM_WORLD);
+          slots[victim].offloadSent = true;
+          upstreamVictim = victim;
+        } else {
+          char offloadFailed = 'x';
+          MPI_Send(&offloadFailed, 1, MPI_CHAR, MASTER_NODE, OFFLOAD_RESP, MPI_COMM_WORLD);
+        }
+        groupLog << "MASTER->GROUP: OFFLOAD Victim:"<<victim<<"\n";
+      } else {
+        std::cout << "ILLEGAL TAG: "<<tag<<" "<<src<<"\n";
+        bool ok = false;
+        (void) ok;
+        assert(ok && "coordinator received an illegal tag");
+      }
+    } else if(tag == FINISH) {
+      groupLog << "WORKER->GROUP: FINISH ID:"<<src<<"\n";
+      //a worker reports each task once, anything else is not ours to count
+      if(slot.busy) {
+        slot.busy = false;
+        --numBusy;
+        workerIdle(src, slot, pressureSet, readySet);
+        slot.free = true;
+        freeQueue.push_back(src);
+      }
+    } else if(tag == READY_TO_OFFLOAD || tag == NOT_READY_TO_OFFLOAD ||
+        tag == MEMORY_PRESSURE) {
+      updateReadiness(tag, src, ctrl[src*CTRL_MSG_SIZE], slot, pressureSet,
+          readySet, readyCounter, groupLog);
+    } else if(tag == NEW_TASK) {
+      std::vector<char> batch;
+      recvPacket(src, ctrl, batch);
+      unsigned numTasks = unpackTasks(batch, tasks);
+      groupLog << "WORKER->GROUP: NEW_TASK ID:"<<src<<" Tasks:"<<numTasks<<"\n";
+    } else if(tag == OFFLOAD_RESP) {
+      bool gave = count == sizeof(uint32_t);
+      std::vector<char> packet;
+      if(gave) recvPacket(src, ctrl, packet);
+      offloadAnswered(src, gave, slot, pressureSet, readySet, readyCounter);
+      groupLog << "WORKER->GROUP: OFFLOAD RCVD ID:"<<src<<" Length:"<<packet.size()<<"\n";
+      if(src == upstreamVictim) {
+        //for another group
+        upstreamVictim = -1;
+        if(gave) {
+          sendPacket(MASTER_NODE, OFFLOAD_RESP, &packet[0], packet.size());
+        } else {
+          char offloadFailed = 'x';
+          MPI_Send(&offloadFailed, 1, MPI_CHAR, MASTER_NODE, OFFLOAD_RESP, MPI_COMM_WORLD);
+        }
+      } else {
+        --pendingOffloads;
+        //queued, the next round gives it to the free worker reserved for it
+        if(gave) tasks.push_front(packet);
+      }
+    } else {
+      std::cout << "ILLEGAL TAG: "<<tag<<" "<<src<<"\n";
+      bool ok = false;
+      (void) ok;
+      assert(ok && "coordinator received an illegal tag");
+    }
+    postControlRecv(src, ctrl, reqs);
+  }
+}
+
+//what the master knows of a group from its last GROUP_STATUS
+struct GroupSlot {
+  bool reported;
+  bool offloadSent;
+  uint32_t busy, idle, donors, received;
+  uint32_t sent; //GROUP_TASK messages
+  GroupSlot() : reported(false), offloadSent(false), busy(0), idle(0),
+    donors(0), received(0), sent(0) {}
+
+  //idle workers no task in flight is meant for yet
+  uint32_t unpromised() const {
+    uint32_t inFlight = sent - received;
+    return idle > inFlight ? idle - inFlight : 0;
+  }
+};
+
+//the master with -group-size: prefixes go to the groups with idle
+//workers, OFFLOAD asks a group with donors for work for another group.
+//The run is over when the worklist is out and every group reported all
+//its tasks received, no donors and no worker busy
+void coordinateGroups(int num_cores, char **workList,
+    std::vector<unsigned int> &pathSizes, std::ofstream &masterLog, time_t *t) {
+  const std::vector<int> &coordinators = theNodeTopology->getCoordinators();
+  std::vector<WorkerSlot> slots(num_cores);
+  std::vector<GroupSlot> groups(num_cores);
+  std::deque< std::vector<char> > splitTasks; //moved between groups
+  unsigned cnt = 0;
+  int pendingOffloads = 0;
+  if(!CheckpointFile.empty())
+    klee_warning("-checkpoint is ignored with -group-size");
+
+  std::vector<char> ctrl(num_cores*CTRL_MSG_SIZE);
+  std::vector<MPI_Request> reqs(num_cores, MPI_REQUEST_NULL);
+  //the workers still report bugs to the master
+  for(int x=1; x<num_cores; ++x) {
+    postControlRecv(x, ctrl, reqs);
+  }
+  for(unsigned i=0; i<coordinators.size(); ++i) {
+    slots[coordinators[i]].started = true;
+  }
+
+  while(true) {
+    bool allDone = cnt == pathSizes.size() && splitTasks.empty() &&
+      pendingOffloads == 0;
+    for(unsigned i=0; allDone && i<coordinators.size(); ++i) {
+      GroupSlot &group = groups[coordinators[i]];
+      allDone = group.reported && !group.busy && !group.donors &&
+        group.received == group.sent;
+    }
+    if(allDone) {
+      masterLog << "MASTER: ALL GROUPS FINISHED \n";
+      shutdownWorkers(coordinators, slots, reqs);
+      masterLog << "MASTER_ELAPSED: \n";
+      logElapsed(masterLog, t);
+      masterLog.close();
+      if(theEventTrace) theEventTrace->dump();
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    //the groups take tasks for their idle workers, the worklist first
+    uint32_t wanted = 0;
+    for(unsigned i=0; i<coordinators.size(); ++i) {
+      int c = coordinators[i];
+      GroupSlot &group = groups[c];
+      while(group.unpromised() && (cnt < pathSizes.size() || !splitTasks.empty())) {
+        if(cnt < pathSizes.size()) {
+          sendPacket(c, GROUP_TASK, workList[cnt], pathSizes[cnt]);
+          if(++cnt == pathSizes.size()) {
+            std::cout << "Done with all prefixes\n";
+            masterLog << "MASTER: DONE_WITH_ALL_PREFIXES\n";
+          }
+        } else {
+          std::vector<char> &packet = splitTasks.front();
+          sendPacket(c, GROUP_TASK, &packet[0], packet.size());
+          splitTasks.pop_front();
+        }
+        ++group.sent;
+        masterLog << "MASTER->GROUP: TASK ID:"<<c<<" Sent:"<<group.sent<<"\n";
+      }
+      wanted += group.unpromised();
+    }
+
+    //the idle workers left over ask the groups with the most donors
+    while((int) wanted > pendingOffloads) {
+      int victim = -1;
+      for(unsigned i=0; i<coordinators.size(); ++i) {
+        GroupSlot &group = groups[coordinators[i]];
+        if(!group.offloadSent && group.donors &&
+            (victim < 0 || group.donors > groups[victim].donors))
+          victim = coordinators[i];
+      }
+      if(victim < 0) break;
+      uint32_t hint[2] = { wanted - pendingOffloads, groups[victim].donors };
+      MPI_Send(hint, sizeof(hint), MPI_CHAR, victim, OFFLOAD, MPI_COMM_WORLD);
+      masterLog << "MASTER->GROUP: OFFLOAD_SENT ID:"<<victim<<"\n";
+      groups[victim].offloadSent = true;
+      ++pendingOffloads;
+    }
+
+    int src;
+    MPI_Status status;
+    {
+      EventTraceSpan idle(EventTrace::Idle);
+      MPI_Waitany(num_cores, &reqs[0], &src, &status);
+    }
+    assert(src != MPI_UNDEFINED && "master has no posted receives");
+    int count;
+    MPI_Get_count(&status, MPI_CHAR, &count);
+
+    if(status.MPI_TAG == GROUP_STATUS) {
+      GroupSlot &group = groups[src];
+      uint32_t counters[4];
+      memcpy(counters, &ctrl[src*CTRL_MSG_SIZE], sizeof(counters));
+      group.busy = counters[0];
+      group.idle = counters[1];
+      group.donors = counters[2];
+      group.received = counters[3];
+      group.reported = true;
+      masterLog << "GROUP->MASTER: STATUS ID:"<<src<<" Busy:"<<group.busy
+        <<" Idle:"<<group.idle<<" Donors:"<<group.donors<<"\n";
+    } else if(status.MPI_TAG == OFFLOAD_RESP) {
+      groups[src].offloadSent = false;
+      --pendingOffloads;
+      masterLog << "GROUP->MASTER: OFFLOAD RCVD ID:"<<src<<" Length:"<<count<<"\n";
+      //handed to the group short of work in the next round
+      if(count == sizeof(uint32_t)) {
+        splitTasks.push_back(std::vector<char>());
+        recvPacket(src, ctrl, splitTasks.back());
+      }
+    } else if(status.MPI_TAG == BUG_FOUND) {
+      masterLog << "WORKER->MASTER:  BUG FOUND:"<<src<<"\n";
+      logElapsed(masterLog, t);
+      masterLog.close();
+      if(theEventTrace) theEventTrace->dump();
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    } else if(status.MPI_TAG == TIMEOUT) {
+      shutdownWorkers(coordinators, slots, reqs);
+      masterLog.close();
+      if(theEventTrace) theEventTrace->dump();
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    } else if(status.MPI_TAG == CHECKPOINT) {
+      //no checkpoints with groups
+    } else {
+      std::cout << "ILLEGAL TAG: "<<status.MPI_TAG<<" "<<src<<"\n";
+      if(FLUSH) std::cout.flush();
+      bool ok = false;
+      (void) ok;
+      assert(ok && "MASTER received an illegal tag");
+    }
+    postControlRecv(src, ctrl, reqs);
+  }
+}
+
 int master(int argc, char **argv, char **envp) {
 
   //setting up the workers 
@@ -1489,10 +2422,12 @@ int master(int argc, char **argv, char **envp) {
 			MPI_Send(&dummychar, 1, MPI_CHAR, 2, KILL, MPI_COMM_WORLD);
 			MPI_Recv(&dummychar, 1, MPI_CHAR, 2, KILL_COMP, MPI_COMM_WORLD, &status4);
 		  masterLog.close();
+		  if(theEventTrace) theEventTrace->dump();
 		  MPI_Abort(MPI_COMM_WORLD, -1);
 		} else if(status3.MPI_TAG == TIMEOUT) {
 			masterLog << "MASTER_ELAPSED Timeout: \n";
 		  masterLog.close();
+		  if(theEventTrace) theEventTrace->dump();
 		  MPI_Abort(MPI_COMM_WORLD, -1);
 		} else if(status3.MPI_TAG == BUG_FOUND) {
 			masterLog << "WORKER->MASTER:  BUG FOUND:"<<status3.MPI_SOURCE<<"\n";
@@ -1503,6 +2438,7 @@ int master(int argc, char **argv, char **envp) {
 			masterLog.close();
 			//MPI_Send(&dummychar, 1, MPI_CHAR, 2, KILL, MPI_COMM_WORLD);
 			//MPI_Recv(&dummychar, 1, MPI_CHAR, 2, KILL_COMP, MPI_COMM_WORLD, &status4);
+		  if(theEventTrace) theEventTrace->dump();
 		  MPI_Abort(MPI_COMM_WORLD, -1);
 		}
 
@@ -1707,295 +2643,29 @@ int master(int argc, char **argv, char **envp) {
 		char** workList;
 		std::vector<unsigned int> pathSizes;
 
-		workList = interpreter->runFunctionAsMain2(mainFn, pArgc, pArgv, pEnvp, pathSizes);
-	 
-		std::vector<unsigned char> dummyprefix;
-		std::deque<unsigned char> dummyWL;
-		std::deque<unsigned int> freeList;
-		std::deque<unsigned int> offloadActiveList;
-		std::deque<unsigned int> busyList;
-		std::deque<unsigned int> offloadReadyList;
-		MPI_Status status2;
-		dummyWL.resize(phase1Depth);
-		//std::ofstream masterLog;
-		//masterLog.open("log_master_"+OutputDir);
-		masterLog << "MASTER_START \n";
-	 
-		//*************Seeding the worker*************
-		int currRank = 2;
-		//auto wListIt = workList.begin();
-		int whileCnt = (num_cores-2)<pathSizes.size()?num_cores-2:pathSizes.size();
-
-		int cnt=0;
-		while(cnt<whileCnt) {
-			std::cout << "Starting worker: "<<currRank<<"\n";
-			masterLog << "MASTER->WORKER: START_WORK ID:"<<currRank<<"\n";
-			if(FLUSH) masterLog.flush();
-			MPI_Send(&(workList[cnt][0]), pathSizes[cnt], MPI_CHAR, currRank, START_PREFIX_TASK, 
-					MPI_COMM_WORLD);
-			busyList.push_back(currRank);
-			++currRank;
-			++cnt;
-		}
-	 
-		//If worklist size is smaller than cores, kill the rest of the processes
-		while(currRank < num_cores) {
-			if(!lb) {
-				char dummy2;
-				MPI_Send(&dummy2, 1, MPI_CHAR, currRank, KILL, MPI_COMM_WORLD);
-				std::cout << "Killing(not required) worker: "<<currRank<<"\n";
-				masterLog << "MASTER->WORKER: KILL ID:"<<currRank<<"\n";
-			}
-			freeList.push_back(currRank);
-			++currRank;
-		}
-
-		//receive FINISH/BUG FOUND/OFFLOAD READY/NOT READY messages 
-		//from workers and offload further work
-		char dummyRecv;
-		MPI_Status status;
-		while(cnt < pathSizes.size()) {
-			MPI_Recv(&dummyRecv, 1, MPI_CHAR, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-			if(status.MPI_TAG == FINISH) {
-				for(auto it = busyList.begin(); it != busyList.end(); ++it) {
-					if (*it == status.MPI_SOURCE) {
-						busyList.erase(it);
-						break;
-					 }
-				}
-				//also remove from offloadReadyList if it exists
-				for(auto it = offloadActiveList.begin(); it != offloadActiveList.end(); ++it) {
-					if (*it == status.MPI_SOURCE) {
-						offloadActiveList.erase(it);
-						break;
-					}
-				}
-
-				masterLog << "WORKER->MASTER: FINISH ID:"<<status.MPI_SOURCE<<"\n";
-				if(FLUSH) masterLog.flush();
-				MPI_Send(&(workList[cnt][0]), pathSizes[cnt], MPI_CHAR, status.MPI_SOURCE,
-					START_PREFIX_TASK, MPI_COMM_WORLD);
-				masterLog << "MASTER->WORKER: START_WORK ID:"<<status.MPI_SOURCE<<"\n";
-				if(FLUSH) masterLog.flush();
-
-				busyList.push_back(status.MPI_SOURCE);
-				cnt++;
-			} else if(status.MPI_TAG == BUG_FOUND) {
-				t[1] = time(NULL);
-				strcpy(buf, "Elapsed: ");
-				strcpy(format_tdiff(buf, t[1] - t[0]), "\n");
-				masterLog<<buf;
-				masterLog.close();
-
-				char dummy;
-				for(int x=2; x<num_cores; ++x) {
-					MPI_Send(&dummy, 1, MPI_CHAR, x, KILL, MPI_COMM_WORLD);
-				}
-			} else if(status.MPI_TAG == READY_TO_OFFLOAD) {
-				//masterLog << "WORKER->MASTER: READY TO OFFLOAD:"<<status.MPI_SOURCE<<"\n";
-				offloadReadyList.push_back(status.MPI_SOURCE);
-			} else if(status.MPI_TAG == NOT_READY_TO_OFFLOAD) {
-				bool found2Erase=false;
-				//masterLog << "WORKER->MASTER: NOT READY TO OFFLOAD:"<<status.MPI_SOURCE<<"\n";
-				for(auto it=offloadReadyList.begin(); it!=offloadReadyList.end(); ++it) {
-					if(*it==status.MPI_SOURCE) {
-						offloadReadyList.erase(it);
-						found2Erase=true;
-						break;
-					}
-				}
-				assert(found2Erase);
-			} else {
-				//should not see any tags here
-				bool ok = false;
-				(void) ok;
-				assert(ok && "MASTER received an illegal tag");
+		if(!RestartFrom.empty()) {
+			//the saved frontier replaces phase 1, spread over the ranks we have now
+			std::deque< std::vector<char> > tasks;
+			if(!readCheckpoint(RestartFrom, tasks))
+				klee_error("cannot read checkpoint '%s'", RestartFrom.c_str());
+			workList = (char **)malloc(tasks.size()*sizeof(char*));
+			for(unsigned x=0; x<tasks.size(); ++x) {
+				workList[x] = (char *)malloc(tasks[x].size());
+				memcpy(workList[x], &tasks[x][0], tasks[x].size());
+				pathSizes.push_back(tasks[x].size());
 			}
-
+			masterLog << "MASTER: RESTART Tasks:"<<tasks.size()<<"\n";
+		} else {
+			workList = interpreter->runFunctionAsMain2(mainFn, pArgc, pArgv, pEnvp, pathSizes);
 		}
-
-		std::cout << "Done with all prefixes\n";
-		masterLog << "MASTER: DONE_WITH_ALL_PREFIXES\n";
+	 
+		masterLog << "MASTER_START \n";
+		if(theNodeTopology->hasGroups())
+			coordinateGroups(num_cores, workList, pathSizes, masterLog, t);
+		else
+			coordinateWorkers(num_cores, workList, pathSizes, masterLog, t);
 		delete workList;
-		if(FLUSH) masterLog.flush();
-		bool offloadActive = false;
-		//masterLog.flush();
-		while(true) {
-			MPI_Status status;
-			int flag=false, count;
-			//char *buffer;
-			//see what the workers are saying
-			MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
-
-			if(flag) {
-				MPI_Get_count(&status, MPI_CHAR, &count);
-				char buffer[count];
-				MPI_Recv(buffer, count, MPI_CHAR, status.MPI_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-				//masterLog << "RECVD something: "<<status.MPI_SOURCE<<" "<<count <<"\n";
-				//masterLog.flush();
-				if(status.MPI_TAG == BUG_FOUND) {
-					masterLog << "WORKER->MASTER:  BUG FOUND:"<<status.MPI_SOURCE<<"\n";
-					t[1] = time(NULL);
-					strcpy(buf, "Elapsed: ");
-					strcpy(format_tdiff(buf, t[1] - t[0]), "\n");
-					masterLog<<buf;
-					masterLog.close();
-					char dummy;
-					MPI_Abort(MPI_COMM_WORLD, -1);
-				} else if(status.MPI_TAG == FINISH) {
-					bool ffound=0;
-					for(auto it=freeList.begin(); it!=freeList.end(); ++it) {
-						if(*it == status.MPI_SOURCE) {
-							ffound=1;
-							break;
-						}
-					}
-					if(!ffound) freeList.push_back(status.MPI_SOURCE);
-
-					for(auto it = busyList.begin(); it != busyList.end(); ++it) {
-						if (*it == status.MPI_SOURCE) {
-							busyList.erase(it);
-							break;
-						 }
-					}
-
-					//also remove from offloadReadyList if it exists
-					for(auto it = offloadActiveList.begin(); it != offloadActiveList.end(); ++it) {
-						if (*it == status.MPI_SOURCE) {
-							offloadActiveList.erase(it);
-              offloadActive = false;
-							break;
-						}
-					}
-					
-          for(auto it=offloadReadyList.begin(); it!=offloadReadyList.end(); ++it) {
-						if(*it==status.MPI_SOURCE) {
-							offloadReadyList.erase(it);
-              break;
-						}
-					}
-
-					masterLog << "WORKER->MASTER: FINISH ID:"<<status.MPI_SOURCE<<"\n";
-					masterLog << "WORKER->MASTER: FREELIST SIZE:"<<freeList.size()<<"\n";
-					if(FLUSH) masterLog.flush();
-					//if all workers finish then shut down the system
-					if(freeList.size() == (num_cores-2)) {
-						masterLog << "MASTER: ALL WORKERS FINISHED \n";
-						if(FLUSH) masterLog.flush();
-						//Kill all the workers
-						char dummy;
-						for(int x=2; x<num_cores; ++x) {
-							MPI_Send(&dummy, 1, MPI_CHAR, x, KILL, MPI_COMM_WORLD);
-						}
-
-						masterLog << "MASTER_ELAPSED: \n";
-						t[1] = time(NULL);
-						strcpy(buf, "Elapsed: ");
-						strcpy(format_tdiff(buf, t[1] - t[0]), "\n");
-						masterLog<<buf;
-						masterLog.close();
-
-						for(int x=2; x<num_cores; ++x) {
-							MPI_Recv(&dummy, 1, MPI_CHAR, x, KILL_COMP, MPI_COMM_WORLD, &status2);
-						}
-						MPI_Abort(MPI_COMM_WORLD, -1);
-					}
-				} else if(status.MPI_TAG == TIMEOUT) {
-					char dummy;
-					for(int x=2; x<num_cores; ++x) {
-						MPI_Send(&dummy, 1, MPI_CHAR, x, KILL, MPI_COMM_WORLD);
-					}
-            
-          for(int x=2; x<num_cores; ++x) {
-              MPI_Recv(&dummy, 1, MPI_CHAR, x, KILL_COMP, MPI_COMM_WORLD, &status2);
-          } 
-          MPI_Abort(MPI_COMM_WORLD, -1);
-
-				} else if(status.MPI_TAG == READY_TO_OFFLOAD) {
-					//masterLog << "WORKER->MASTER: READY TO OFFLOAD:"<<status.MPI_SOURCE<<"\n";
-					offloadReadyList.push_back(status.MPI_SOURCE);
-				} else if(status.MPI_TAG == NOT_READY_TO_OFFLOAD) {
-					bool found2Erase=false;
-					//masterLog << "WORKER->MASTER: NOT READY TO OFFLOAD:"<<status.MPI_SOURCE<<"\n";
-					for(auto it=offloadReadyList.begin(); it!=offloadReadyList.end(); ++it) {
-						if(*it==status.MPI_SOURCE) {
-							offloadReadyList.erase(it);
-							found2Erase=true;
-							break;
-						}
-					}
-					//assert(found2Erase);
-				} else if(status.MPI_TAG == OFFLOAD_RESP) {
-					masterLog << "WORKER->MASTER: OFFLOAD RCVD ID:"<<status.MPI_SOURCE<<" Length:"<<count<<"\n";
-					if(FLUSH) masterLog.flush();
-
-					//Removing the offload active list worker 
-					for(auto it = offloadActiveList.begin(); it != offloadActiveList.end(); ++it) {
-						if (*it == status.MPI_SOURCE) {
-							offloadActiveList.erase(it);
-							break;
-						}
-					}
-
-					//Send the offloaded work to the free worker 
-					if(count>4) {
-						//something should exist in free list
-						assert(freeList.size() > 0);
-						unsigned int pickedWorker = freeList.front();
-						masterLog << "MASTER->WORKER: PREFIX_TASK_SEND ID:"<<pickedWorker<<" Length:"<<count<<"\n";
-						MPI_Send(buffer, count, MPI_CHAR, pickedWorker, START_PREFIX_TASK, MPI_COMM_WORLD);
-						masterLog << "MASTER->WORKER: START_WORK ID:"<<pickedWorker<<"\n";
-						//pushing the worker busy list
-						busyList.push_back(pickedWorker);
-						freeList.pop_front();
-					}
-					offloadActive = false;
-				} else {
-					//should not see any tags here
-					std::cout << "ILLEGAL TAG: "<<status.MPI_TAG<<" "<<status.MPI_SOURCE<<"\n";
-					if(FLUSH) std::cout.flush();
-					bool ok = false;
-					(void) ok;
-					assert(ok && "MASTER received an illegal tag");
-				}
-			}
 
-			//if some workers are ready to offload and freelist has some workers
-			//offload some stuff
-			if(lb && (freeList.size()>0) && (freeList.size()<(num_cores-2))
-				 && (offloadReadyList.size()>0) && !offloadActive) {
-
-				//pick out the worker that has been busy the longest and to whom an
-				//offload request in not yet sent
-				bool foundWorker2Offload = false;
-				unsigned int worker2offload;
-				for(auto it = offloadReadyList.begin(); it != offloadReadyList.end(); ++it) {
-					bool offloadAlreadySent = false;
-					for(auto it2 = offloadActiveList.begin(); it2 < offloadActiveList.end(); ++it2) {
-						if(*it == *it2) {
-							offloadAlreadySent = true;
-							break;
-						}
-					}
-					if(!offloadAlreadySent) {
-						foundWorker2Offload = true;
-						worker2offload = *it;
-						offloadActiveList.push_back(worker2offload);
-						break;
-					}
-				}
-				//found a valid busy worker
-				if(foundWorker2Offload) {
-					MPI_Status offloadStatus;
-					char dummyBuff;
-					MPI_Send(&dummyBuff, 1, MPI_CHAR, worker2offload, OFFLOAD, MPI_COMM_WORLD);
-					masterLog << "MASTER->WORKER: OFFLOAD_SENT ID:"<<worker2offload<<"\n";
-					if(FLUSH) masterLog.flush();
-					offloadActive = true;
-				}
-			}
-		}
-		
 		// Free all the args.
 		for (unsigned i=0; i<InputArgv.size()+1; i++)
 			delete[] pArgv[i];
@@ -2056,76 +2726,123 @@ int master(int argc, char **argv, char **envp) {
 void worker(int argc, char **argv, char **envp) {
   int world_rank;
   char result;
-  char** dummyworkList;
+  SysPointers sp;
+  bool runtimeReady = false;
+  //the master, or the coordinator of our group
+  int coordinator = theNodeTopology->getCoordinator();
 
   while(true) {
     MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
-    //trying to check the TAG of incoming message
+    //trying to check the TAG of incoming message, peers only talk to us
+    //when stealing is enabled
     MPI_Status status;
-    MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+    {
+      EventTraceSpan idle(EventTrace::Idle);
+      MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+    }
     int count;
     MPI_Get_count(&status, MPI_CHAR, &count);
 
+    if(status.MPI_SOURCE != coordinator) {
+      //nothing to give away outside a task, stale replies are dropped
+      std::vector<char> peerMsg(count);
+      MPI_Recv(&peerMsg[0], count, MPI_CHAR, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, &status);
+      if(status.MPI_TAG == STEAL_REQ) {
+        char stealFailed = 'x';
+        MPI_Send(&stealFailed, 1, MPI_CHAR, status.MPI_SOURCE, STEAL_RESP, MPI_COMM_WORLD);
+      }
+      continue;
+    }
+
     if(status.MPI_TAG == KILL) {
       std::deque<unsigned char> recv_prefix;
       recv_prefix.resize(phase1Depth);
-      MPI_Recv(&recv_prefix[0], phase1Depth, MPI_CHAR, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+      MPI_Recv(&recv_prefix[0], phase1Depth, MPI_CHAR, coordinator, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
       std::cout << "Killing Process: "<<world_rank<<"\n";
+      //the master aborts the run once every KILL_COMP is in
+      if(theEventTrace) theEventTrace->dump();
+      if(runtimeReady) {
+        finishWorker(sp);
+        MPI_Send(&result, 1, MPI_CHAR, coordinator, KILL_COMP, MPI_COMM_WORLD);
+      }
       return;
 
     } else if(status.MPI_TAG == START_PREFIX_TASK) {
       //std::vector<unsigned char> recv_prefix;
       //recv_prefix.resize(count);
       char* recv_prefix = (char*)malloc((count)*sizeof(char)); 
-      MPI_Recv(recv_prefix, count, MPI_CHAR, 0, START_PREFIX_TASK, MPI_COMM_WORLD, &status);
-      std::cout << "Process: "<<world_rank<<" Prefix Task: Length:"<<count<<" ";
-      //std::cout.flush();
-      for(unsigned int x=count-10;x<count;x++) {
-        std::cout<<recv_prefix[x];
+      MPI_Recv(recv_prefix, count, MPI_CHAR, coordinator, START_PREFIX_TASK, MPI_COMM_WORLD, &status);
+      //the prefix is a packed PrefixPacket, decoded by the executor
+      std::cout << "Process: "<<world_rank<<" Prefix Task: Packet Length:"<<count<<"\n";
+      if(!runtimeReady) {
+        if(setupWorker(argc, argv, envp, sp) != 0) return;
+        runtimeReady = true;
       }
-      std::cout<<"\n";
-      executeWorker(argc, argv, envp, dummyworkList, recv_prefix, count, phase2Depth, 
+      //the executor serves every follow-up prefix on the resident module
+      //and only returns once the coordinator sends KILL (left pending for us)
+      executeWorker(sp, recv_prefix, count, phase2Depth, 
           PREFIX_MODE, getNewSearch());
       std::cout << "Finish: " << world_rank << std::endl;
-      delete recv_prefix;
-      //MPI_Send(&result, 1, MPI_CHAR, 0, FINISH, MPI_COMM_WORLD);
-      MPI_Send(&result, 1, MPI_CHAR, 0, KILL_COMP, MPI_COMM_WORLD);
-      return;
+      free(recv_prefix);
 		} else if(status.MPI_TAG == NORMAL_TASK) {
       std::cout << "Process: "<<world_rank<<" Normal Task "<<"Prefix Depth: "<<phase2Depth<<"\n";
       char* recv_prefix = (char*)malloc((count+1)*sizeof(char)); 
       MPI_Recv(recv_prefix, count, MPI_CHAR, 0, NORMAL_TASK, MPI_COMM_WORLD, &status);
-      executeWorker(argc, argv, envp, dummyworkList, recv_prefix, count, phase2Depth, 
+      if(!runtimeReady) {
+        if(setupWorker(argc, argv, envp, sp) != 0) return;
+        runtimeReady = true;
+      }
+      //FINISH is reported by the executor once the task runs dry
+      executeWorker(sp, recv_prefix, count, phase2Depth, 
           NO_MODE, getNewSearch());
-      MPI_Send(&result, 1, MPI_CHAR, 0, FINISH, MPI_COMM_WORLD);
+      free(recv_prefix);
+
+    } else if(status.MPI_TAG == STEAL_TASK) {
+      char dummy;
+      MPI_Recv(&dummy, 1, MPI_CHAR, 0, STEAL_TASK, MPI_COMM_WORLD, &status);
+      std::cout << "Process: "<<world_rank<<" Steal Task\n";
+      if(!runtimeReady) {
+        if(setupWorker(argc, argv, envp, sp) != 0) return;
+        runtimeReady = true;
+      }
+      //no prefix, the executor starts by stealing from its peers
+      executeWorker(sp, NULL, 0, phase2Depth, PREFIX_MODE, getNewSearch());
+
+    } else if(status.MPI_TAG == CHECKPOINT) {
+      //outside a task there is nothing to save
+      char dummy;
+      MPI_Recv(&dummy, 1, MPI_CHAR, MASTER_NODE, CHECKPOINT, MPI_COMM_WORLD, &status);
+      uint32_t len = 0;
+      MPI_Send(&len, sizeof(len), MPI_CHAR, MASTER_NODE, CHECKPOINT_RESP, MPI_COMM_WORLD);
 
     } else if(status.MPI_TAG == OFFLOAD) {
-      int count, buffer;
-      MPI_Get_count(&status, MPI_INT, &count);
-      MPI_Recv(&buffer, count, MPI_INT, MASTER_NODE, OFFLOAD, MPI_COMM_WORLD, &status);
+      uint32_t hint[2];
+      MPI_Recv(hint, sizeof(hint), MPI_CHAR, coordinator, OFFLOAD, MPI_COMM_WORLD, &status);
       std::vector<unsigned char> packet2send;
       packet2send.push_back('x');
-      MPI_Send(&packet2send[0], packet2send.size(), MPI_CHAR, 0, OFFLOAD_RESP, MPI_COMM_WORLD);
+      MPI_Send(&packet2send[0], packet2send.size(), MPI_CHAR, coordinator, OFFLOAD_RESP, MPI_COMM_WORLD);
 
+    } else if(status.MPI_TAG == STEAL_ACK) {
+      //the executor waits for every ack before its FINISH, none is left
+      char ack;
+      MPI_Recv(&ack, 1, MPI_CHAR, coordinator, STEAL_ACK, MPI_COMM_WORLD, &status);
     } 
   }
 }
 
-int executeWorker(int argc, char **argv, char **envp, 
-    char** workList, char* prefix, unsigned int count, 
-		int explorationDepth, int mode, std::string searchMode) {
+//loads and links the program and builds the interpreter once per rank
+int setupWorker(int argc, char **argv, char **envp, SysPointers &sp) {
 
   std::string ErrorMsg;
   Module *mainModule = 0;
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
-  OwningPtr<MemoryBuffer> BufferPtr;
-  error_code ec=MemoryBuffer::getFileOrSTDIN(InputFile.c_str(), BufferPtr);
+  error_code ec=MemoryBuffer::getFileOrSTDIN(InputFile.c_str(), sp.BufferPtr);
   if (ec) {
     klee_error("error loading program '%s': %s", InputFile.c_str(),
                ec.message().c_str());
   }
 
-  mainModule = getLazyBitcodeModule(BufferPtr.get(), getGlobalContext(), &ErrorMsg);
+  mainModule = getLazyBitcodeModule(sp.BufferPtr.get(), getGlobalContext(), &ErrorMsg);
 
   if (mainModule) {
     if (mainModule->MaterializeAllPermanently(&ErrorMsg)) {
@@ -2287,8 +3004,33 @@ int executeWorker(int argc, char **argv, char **envp,
 	  interpreter->setModule(mainModule, Opts);
 	externalsAndGlobalsCheck(finalModule);
 
-	std::string output_dir_file;
-	std::string pthfile;
+	int world_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+	std::string output_dir_file = handler->getOutputDir();
+	interpreter->setPathFile(output_dir_file+"_pathFile_"+std::to_string(world_rank));
+	interpreter->setBrHistFile(output_dir_file+"_br_hist");
+	interpreter->setLogFile(output_dir_file+"_log_file");
+	interpreter->enableLoadBalancing(lb);
+	std::cout<<"DMap World Rank: "<<world_rank<<" File: " <<output_dir_file<<std::endl;
+
+  sp.module = mainModule;
+  sp.mainFn = mainFn;
+  sp.interpreter = interpreter;
+  sp.handler = handler;
+  sp.pArgc = pArgc;
+  sp.pArgv = pArgv;
+  sp.pEnvp = pEnvp;
+  return 0;
+}
+
+//runs a single task on the resident runtime, only the per-task bounds
+//and search settings are touched here
+int executeWorker(SysPointers &sp, char* prefix, unsigned int count, 
+		int explorationDepth, int mode, std::string searchMode) {
+
+  Interpreter *interpreter = sp.interpreter;
+  KleeHandler *handler = sp.handler;
 
 	char buf[256];
 	time_t t[2];
@@ -2309,21 +3051,10 @@ int executeWorker(int argc, char **argv, char **envp,
   if(mode == NO_MODE) {
     interpreter->setTestPrefixDepth(0);
   }
-	
-	int world_rank;
-	MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
 
-	interpreter->enableLoadBalancing(lb);
 	interpreter->setSearchMode(searchMode);
-	pthfile = handler->getOutputDir()+"_pathFile_"+std::to_string(world_rank);
-	interpreter->setPathFile(pthfile);
-
-	output_dir_file = handler->getOutputDir();
-	interpreter->setBrHistFile(output_dir_file+"_br_hist");
-	interpreter->setLogFile(output_dir_file+"_log_file");
-	std::cout<<"DMap World Rank: "<<world_rank<<" File: " <<output_dir_file<<std::endl;
   std::vector<unsigned int> pathSizes;
-	interpreter->runFunctionAsMain2(mainFn, pArgc, pArgv, pEnvp, pathSizes);
+	interpreter->runFunctionAsMain2(sp.mainFn, sp.pArgc, sp.pArgv, sp.pEnvp, pathSizes);
 
   //time_t t;
   t[1] = time(NULL);
@@ -2334,13 +3065,20 @@ int executeWorker(int argc, char **argv, char **envp,
   strcpy(format_tdiff(buf, t[1] - t[0]), "\n");
   handler->getInfoStream() << buf;
 
+  return 0;
+}
+
+//tears down the resident runtime and reports the accumulated stats
+void finishWorker(SysPointers &sp) {
+  KleeHandler *handler = sp.handler;
 
   // Free all the args.
   for (unsigned i=0; i<InputArgv.size()+1; i++)
-    delete[] pArgv[i];
-  delete[] pArgv;
+    delete[] sp.pArgv[i];
+  delete[] sp.pArgv;
 
-  delete interpreter;
+  delete sp.interpreter;
+  theInterpreter = 0;
 
   uint64_t queries =
     *theStatisticManager->getStatisticByName("Queries");
@@ -2356,6 +3094,18 @@ int executeWorker(int argc, char **argv, char **envp,
     *theStatisticManager->getStatisticByName("Instructions");
   uint64_t forks =
     *theStatisticManager->getStatisticByName("Forks");
+  uint64_t suspendedPeak =
+    *theStatisticManager->getStatisticByName("SuspendedStateBytesPeak");
+  uint64_t suspendedEvicted =
+    *theStatisticManager->getStatisticByName("EvictedSuspendedStates");
+  uint64_t recoveryMemoHits =
+    *theStatisticManager->getStatisticByName("RecoveryMemoHits");
+  uint64_t snapshotBytesTotal =
+    *theStatisticManager->getStatisticByName("SnapshotBytesTotal");
+  uint64_t memoryEvictedStates =
+    *theStatisticManager->getStatisticByName("MemoryEvictedStates");
+  uint64_t splitTasks =
+    *theStatisticManager->getStatisticByName("SplitTasks");
 
   handler->getInfoStream()
     << "KLEE: done: explored paths = " << 1 + forks << "\n";
@@ -2371,6 +3121,51 @@ int executeWorker(int argc, char **argv, char **envp,
     << "KLEE: done: valid queries = " << queriesValid << "\n"
     << "KLEE: done: invalid queries = " << queriesInvalid << "\n"
     << "KLEE: done: query cex = " << queryCounterexamples << "\n";
+  handler->getInfoStream()
+    << "KLEE: done: suspended state budget = " << SuspendedStateBudget << " MB\n"
+    << "KLEE: done: suspended state bytes (peak) = " << suspendedPeak << "\n"
+    << "KLEE: done: evicted suspended states = " << suspendedEvicted << "\n"
+    << "KLEE: done: memoized recoveries reused = " << recoveryMemoHits << "\n"
+    << "KLEE: done: snapshot bytes taken (cumulative) = " << snapshotBytesTotal << "\n"
+    << "KLEE: done: states evicted over the memory cap (replayed from main) = " << memoryEvictedStates << "\n"
+    << "KLEE: done: bounded states sent back as tasks = " << splitTasks << "\n";
+  if (theSharedQueryCache) {
+    uint64_t cacheLocalHits =
+      *theStatisticManager->getStatisticByName("SharedCacheLocalHits");
+    uint64_t cacheRemoteHits =
+      *theStatisticManager->getStatisticByName("SharedCacheRemoteHits");
+    uint64_t cacheMisses =
+      *theStatisticManager->getStatisticByName("SharedCacheMisses");
+    handler->getInfoStream()
+      << "KLEE: done: shared query cache local hits = " << cacheLocalHits << "\n"
+      << "KLEE: done: shared query cache remote hits = " << cacheRemoteHits << "\n"
+      << "KLEE: done: shared query cache misses = " << cacheMisses << "\n";
+  }
+  uint64_t internLookups =
+    *theStatisticManager->getStatisticByName("ExprInternLookups");
+  if (internLookups) {
+    uint64_t internHits =
+      *theStatisticManager->getStatisticByName("ExprInternHits");
+    handler->getInfoStream()
+      << "KLEE: done: constraint nodes looked up for hash-consing = " << internLookups << "\n"
+      << "KLEE: done: constraint nodes shared by hash-consing = " << internHits
+      << " (" << 100. * internHits / internLookups << "%)\n";
+  }
+  if (theCoverageShare) {
+    uint64_t coverageImported =
+      *theStatisticManager->getStatisticByName("ImportedCoverage");
+    uint64_t coveragePublished =
+      *theStatisticManager->getStatisticByName("CoveragePublished");
+    handler->getInfoStream()
+      << "KLEE: done: instructions covered first by other ranks = " << coverageImported << "\n"
+      << "KLEE: done: coverage words published = " << coveragePublished << "\n";
+  }
+
+  uint64_t replayed =
+    *theStatisticManager->getStatisticByName("ReplayedInstructions");
+  if (replayed)
+    handler->getInfoStream()
+      << "KLEE: done: instructions replayed inside prefixes = " << replayed << "\n";
 
   std::stringstream stats;
   stats << "\n";
@@ -2410,9 +3205,8 @@ int executeWorker(int argc, char **argv, char **envp,
   // FIXME: This really doesn't look right
   // This is preventing the module from being
   // deleted automatically
-  BufferPtr.take();
+  sp.BufferPtr.take();
 #endif
 
-  return 0;
-
+  delete handler;
 }